@@ -11,13 +11,28 @@
 #include "icu_ext.h"
 
 #include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#else
+#include "access/hash.h"
+#endif
+#include "executor/spi.h"
 #include "funcapi.h"
+#include "lib/ilist.h"
+#include "lib/stringinfo.h"
 #include "miscadmin.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/pg_locale.h"
+#include "utils/tuplestore.h"
 #include "mb/pg_wchar.h"
 
 #include "unicode/ubrk.h"
+#include "unicode/uchar.h"
 #include "unicode/ucnv.h"
 #include "unicode/ucol.h"
 #include "unicode/uloc.h"
@@ -33,107 +48,573 @@ PG_FUNCTION_INFO_V1(icu_character_boundaries);
 PG_FUNCTION_INFO_V1(icu_word_boundaries);
 PG_FUNCTION_INFO_V1(icu_sentence_boundaries);
 PG_FUNCTION_INFO_V1(icu_line_boundaries);
+PG_FUNCTION_INFO_V1(icu_grapheme_count);
+PG_FUNCTION_INFO_V1(icu_word_count);
+PG_FUNCTION_INFO_V1(icu_sentence_count);
+PG_FUNCTION_INFO_V1(icu_character_offsets);
+PG_FUNCTION_INFO_V1(icu_word_offsets);
+PG_FUNCTION_INFO_V1(icu_line_offsets);
+PG_FUNCTION_INFO_V1(icu_sentence_offsets);
+PG_FUNCTION_INFO_V1(icu_boundaries_rules);
+PG_FUNCTION_INFO_V1(icu_boundaries_named_rules);
+PG_FUNCTION_INFO_V1(icu_break_rules_compile);
+PG_FUNCTION_INFO_V1(icu_break_rules_trigger);
+PG_FUNCTION_INFO_V1(icu_wrap);
+PG_FUNCTION_INFO_V1(icu_wrap_lines);
 
 
-struct ubreak_ctxt {
+/*
+ * Cache of break iterators by type and locale, or by rules.
+ * Opening a break iterator loads its rules and, for some locales
+ * (th, ja, zh, km...), large dictionaries, or compiles the rules
+ * passed by the user. The cached iterators are used as templates and
+ * never iterate themselves: callers get clones of them, which are
+ * cheap to make and that they close when done.
+ * The entries are kept in most-recently-used order, and the least
+ * recently used iterator is closed beyond BREAK_CACHE_SIZE entries.
+ */
+#define BREAK_CACHE_SIZE	8
+
+/*
+ * Kinds of cache entries besides the UBreakIteratorType values,
+ * for which the key is a locale name.
+ */
+#define BREAK_RULES_SOURCE	(-1)	/* key: rules in the database encoding */
+#define BREAK_RULES_BINARY	(-2)	/* key: binary rules, used in place by ICU */
+
+/*
+ * Not a kind of cache entry: rules looked up by name in the
+ * icu_break_rules table, that are cached as BREAK_RULES_BINARY
+ * or BREAK_RULES_SOURCE.
+ * Binary rules are only taken from that table, where they are always
+ * produced by ubrk_getBinaryRules(), since ICU trusts their contents.
+ */
+#define BREAK_RULES_NAMED	(-3)
+
+typedef struct break_cache_entry
+{
+	dlist_node	node;
+	int			kind;			/* UBreakIteratorType or BREAK_RULES_* */
+	uint32		hash;			/* hash of the key */
+	int			keylen;
+	char	   *key;			/* not NUL-terminated */
 	UBreakIterator *iter;
-	UText* ut;
-	char* source_text;
-	UChar* cnv_text;		/* unused and NULL if the database encoding is UTF-8 */
-	int32_t len;
-	TupleDesc tupdesc;
-};
+} break_cache_entry;
+
+static dlist_head break_cache = DLIST_STATIC_INIT(break_cache);
+static int break_cache_count = 0;
 
 /*
- * Initialize the context to iterate on the input.
- * arg1=input string, arg2=locale
- * The main difference between break iterators is:
- * - UBRK_CHARACTER: return SETOF text
- * - others: return SETOF (int,text)
+ * Compile break rules in the database encoding, reporting syntax
+ * errors with their position.
  */
-static void
-init_srf_first_call(UBreakIteratorType break_type, PG_FUNCTION_ARGS)
+static UBreakIterator*
+compile_break_rules(const char *rules, int len)
 {
-	MemoryContext oldcontext;
-	const char *brk_locale;
+	UChar	   *urules;
+	int32_t		ulen;
+	UParseError parse_error;
+	UErrorCode	status = U_ZERO_ERROR;
+	UBreakIterator *brk;
+
+	ulen = string_to_uchar(&urules, rules, len);
+
+	brk = ubrk_openRules(urules, ulen, NULL, 0, &parse_error, &status);
+	pfree(urules);
+	if (U_FAILURE(status))
+	{
+		if (parse_error.line > 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("failed to compile break rules: %s", u_errorName(status)),
+					 errdetail("The error is at line %d, offset %d.",
+							   parse_error.line, parse_error.offset)));
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("failed to compile break rules: %s", u_errorName(status))));
+	}
+	ICU_EXT_COUNT(ICU_STAT_UBRK_OPEN, 1);
+	return brk;
+}
+
+/*
+ * Return the cached template iterator for the kind and key,
+ * opening it if necessary.
+ */
+static UBreakIterator*
+break_iterator_template(int kind, const char *key, int keylen)
+{
+	uint32		hash = DatumGetUInt32(hash_any((const unsigned char *) key, keylen));
+	dlist_iter	iter;
+	break_cache_entry *entry;
+	UBreakIterator *brk = NULL;
+	char	   *stored_key = NULL;
 	UErrorCode	status = U_ZERO_ERROR;
-	FuncCallContext *funcctx;
-	struct ubreak_ctxt *ctxt;
 
-	funcctx = SRF_FIRSTCALL_INIT();
+	dlist_foreach(iter, &break_cache)
+	{
+		entry = dlist_container(break_cache_entry, node, iter.cur);
+		if (entry->hash == hash &&
+			entry->kind == kind &&
+			entry->keylen == keylen &&
+			memcmp(entry->key, key, keylen) == 0)
+		{
+			dlist_move_head(&break_cache, &entry->node);
+			ICU_EXT_COUNT(ICU_STAT_BREAK_ITERATOR_CACHE_HIT, 1);
+			return entry->iter;
+		}
+	}
+	ICU_EXT_COUNT(ICU_STAT_BREAK_ITERATOR_CACHE_MISS, 1);
+
+	switch (kind)
+	{
+		case BREAK_RULES_SOURCE:
+			brk = compile_break_rules(key, keylen);
+			stored_key = MemoryContextAlloc(TopMemoryContext, keylen);
+			memcpy(stored_key, key, keylen);
+			break;
 
-	/*
-	 * Switch to memory context appropriate for multiple function calls
-	 */
-	oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		case BREAK_RULES_BINARY:
+#if U_ICU_VERSION_MAJOR_NUM >= 59
+			/* ICU does not copy the rules, the cache entry owns them */
+			stored_key = MemoryContextAlloc(TopMemoryContext, keylen);
+			memcpy(stored_key, key, keylen);
+			brk = ubrk_openBinaryRules((const uint8_t *) stored_key, keylen,
+									   NULL, 0, &status);
+			if (U_FAILURE(status))
+			{
+				pfree(stored_key);
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid binary break rules: %s", u_errorName(status)),
+						 errhint("Binary rules must be compiled by icu_break_rules_compile() with the same version of ICU.")));
+			}
+			ICU_EXT_COUNT(ICU_STAT_UBRK_OPEN, 1);
+#else
+			elog(ERROR, "binary break rules require ICU 59 or newer");
+#endif
+			break;
 
-	ctxt = palloc(sizeof(struct ubreak_ctxt));
+		default:
+			/* the key is a NUL-terminated locale name */
+			brk = ubrk_open((UBreakIteratorType) kind, key, NULL, 0, &status);
+			if (U_FAILURE(status))
+				elog(ERROR, "ubrk_open failed: %s", u_errorName(status));
+			ICU_EXT_COUNT(ICU_STAT_UBRK_OPEN, 1);
+			stored_key = MemoryContextAlloc(TopMemoryContext, keylen);
+			memcpy(stored_key, key, keylen);
+			break;
+	}
 
-	if (break_type != UBRK_CHARACTER)
+	/* make room for the new entry */
+	if (break_cache_count >= BREAK_CACHE_SIZE)
 	{
-		TupleDesc	tupdesc;
-		/* Construct tuple descriptor */
-		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-			ereport(ERROR,
-					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					 errmsg("function returning record called in context that cannot accept type record")));
-		ctxt->tupdesc = BlessTupleDesc(tupdesc);
+		entry = dlist_container(break_cache_entry, node,
+								dlist_tail_node(&break_cache));
+		dlist_delete(&entry->node);
+		break_cache_count--;
+		ubrk_close(entry->iter);
+		pfree(entry->key);
+		pfree(entry);
+	}
+
+	entry = MemoryContextAlloc(TopMemoryContext, sizeof(break_cache_entry));
+	entry->kind = kind;
+	entry->hash = hash;
+	entry->keylen = keylen;
+	entry->key = stored_key;
+	entry->iter = brk;
+	dlist_push_head(&break_cache, &entry->node);
+	break_cache_count++;
+
+	return brk;
+}
+
+/* Return a clone of a template iterator, to be closed by the caller */
+static UBreakIterator*
+clone_break_iterator(UBreakIterator *template)
+{
+	UBreakIterator *brk;
+	UErrorCode	status = U_ZERO_ERROR;
+
+#if U_ICU_VERSION_MAJOR_NUM >= 69
+	brk = ubrk_clone(template, &status);
+#else
+	brk = ubrk_safeClone(template, NULL, NULL, &status);
+#endif
+	if (U_FAILURE(status))
+		elog(ERROR, "cloning the break iterator failed: %s", u_errorName(status));
+
+	return brk;
+}
+
+/*
+ * Return a new break iterator for the type and locale, to be closed
+ * by the caller with ubrk_close().
+ */
+UBreakIterator*
+open_break_iterator(UBreakIteratorType break_type, const char *locale)
+{
+	return clone_break_iterator(break_iterator_template(break_type,
+														locale,
+														strlen(locale)));
+}
+
+/*
+ * Return a new break iterator for the break rules registered under
+ * @name in the icu_break_rules table, which is in the schema of the
+ * function @fn_oid.
+ * The binary form of the rules is used when it was produced by the
+ * running version of ICU, otherwise the rules are compiled.
+ */
+static UBreakIterator*
+open_named_break_rules(Oid fn_oid, text *name)
+{
+	char	   *nspname = get_namespace_name(get_func_namespace(fn_oid));
+	StringInfoData query;
+	Oid			argtype = TEXTOID;
+	Datum		arg = PointerGetDatum(name);
+	HeapTuple	tuple;
+	TupleDesc	tupdesc;
+	Datum		rules;
+	Datum		binary_rules;
+	bool		isnull;
+	char	   *rules_version;
+	UVersionInfo version;
+	char		buf[U_MAX_VERSION_STRING_LENGTH + 1];
+	UBreakIterator *brk;
+
+	initStringInfo(&query);
+	appendStringInfo(&query,
+					 "SELECT rules, binary_rules, icu_version FROM %s.icu_break_rules WHERE name = $1",
+					 quote_identifier(nspname));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "SPI_connect failed");
+
+	if (SPI_execute_with_args(query.data, 1, &argtype, &arg, NULL,
+							  true, 1) != SPI_OK_SELECT)
+		elog(ERROR, "SPI_execute_with_args failed");
+
+	if (SPI_processed == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_OBJECT),
+				 errmsg("break rules \"%s\" do not exist",
+						text_to_cstring(name))));
+
+	tuple = SPI_tuptable->vals[0];
+	tupdesc = SPI_tuptable->tupdesc;
+	rules = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+	binary_rules = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+	rules_version = SPI_getvalue(tuple, tupdesc, 3);
+
+	u_getVersion(version);
+	u_versionToString(version, buf);
+
+	if (!isnull && rules_version != NULL && strcmp(rules_version, buf) == 0)
+	{
+		bytea	   *binary = DatumGetByteaPP(binary_rules);
+
+		brk = break_iterator_template(BREAK_RULES_BINARY,
+									  VARDATA_ANY(binary),
+									  VARSIZE_ANY_EXHDR(binary));
 	}
 	else
-		ctxt->tupdesc = NULL;
+	{
+		text	   *source = DatumGetTextPP(rules);
 
+		brk = break_iterator_template(BREAK_RULES_SOURCE,
+									  VARDATA_ANY(source),
+									  VARSIZE_ANY_EXHDR(source));
+	}
+	brk = clone_break_iterator(brk);
+
+	SPI_finish();
+
+	return brk;
+}
+
+/*
+ * Return a new break iterator for the type and locale (arg2), or for
+ * the rules (arg2) when kind is BREAK_RULES_SOURCE, or for the rules
+ * named by arg2 when kind is BREAK_RULES_NAMED.
+ */
+static UBreakIterator*
+open_break_iterator_from_arg(int kind, PG_FUNCTION_ARGS)
+{
+	struct varlena *arg = PG_GETARG_VARLENA_PP(1);
+
+	if (kind >= 0)
+		return open_break_iterator((UBreakIteratorType) kind,
+								   text_to_cstring((text *) arg));
+
+	if (kind == BREAK_RULES_NAMED)
+		return open_named_break_rules(fcinfo->flinfo->fn_oid, (text *) arg);
+
+	return clone_break_iterator(break_iterator_template(kind,
+														VARDATA_ANY(arg),
+														VARSIZE_ANY_EXHDR(arg)));
+}
+
+/*
+ * Set a break iterator on the string @s of @len bytes in the database
+ * encoding. The caller must close *ut with utext_close() besides the
+ * iterator.
+ * UTF-8 strings are iterated on directly, others are converted into
+ * @local_buf or scratch slot 0 and *cnv_text points to the result.
+ * Offsets are in bytes in the first case, UTF-16 units in the second.
+ */
+static void
+set_break_text(UBreakIterator *iter, const char *s, int32_t len,
+			   UChar *local_buf, UText **ut, UChar **cnv_text)
+{
+	UErrorCode	status = U_ZERO_ERROR;
 
 	/* Use the UTF-8 ICU functions if our string is in UTF-8 */
 	if (GetDatabaseEncoding() == PG_UTF8)
 	{
-		text *txt = PG_GETARG_TEXT_PP(0);
-		ctxt->len = VARSIZE_ANY_EXHDR(txt);
-		ctxt->source_text = (char*)palloc(ctxt->len);
-		ctxt->cnv_text = NULL;
-		memcpy(ctxt->source_text, VARDATA_ANY(txt), ctxt->len);
-
-		ctxt->ut = utext_openUTF8(NULL,
-								  ctxt->source_text,
-								  ctxt->len,
-								  &status);		
+		*cnv_text = NULL;
+		*ut = utext_openUTF8(NULL, s, len, &status);
 		if (U_FAILURE(status))
+		{
+			ubrk_close(iter);
 			elog(ERROR, "utext_openUTF8() failed: %s", u_errorName(status));
+		}
 	}
 	else
 	{
-		text *input = PG_GETARG_TEXT_PP(0);
-		/* database encoding to UChar buffer */
-		ctxt->len = string_to_uchar(&ctxt->cnv_text,
-								 text_to_cstring(input),
-								 VARSIZE_ANY_EXHDR(input));
-
-		ctxt->ut = utext_openUChars(NULL,
-									ctxt->cnv_text,
-									ctxt->len,
-									&status);
+		int32_t ulen = string_to_uchar_scratch(cnv_text, local_buf, 0, s, len);
+
+		*ut = utext_openUChars(NULL, *cnv_text, ulen, &status);
 		if (U_FAILURE(status))
+		{
+			ubrk_close(iter);
 			elog(ERROR, "utext_openUChars() failed: %s", u_errorName(status));
+		}
 	}
 
+	ubrk_setUText(iter, *ut, &status);
+	if (U_FAILURE(status))
+	{
+		ubrk_close(iter);
+		utext_close(*ut);
+		elog(ERROR, "ubrk_setText() failed: %s", u_errorName(status));
+	}
+}
 
-	funcctx->user_fctx = (void *) ctxt;
-	brk_locale = text_to_cstring(PG_GETARG_TEXT_PP(1));
-	MemoryContextSwitchTo(oldcontext);
+/*
+ * Return the binary form of break rules, that can be passed to
+ * ubrk_openBinaryRules() instead of compiling the rules again.
+ */
+static bytea*
+break_rules_binary(const char *rules, int len)
+{
+#if U_ICU_VERSION_MAJOR_NUM >= 59
+	UBreakIterator *brk = break_iterator_template(BREAK_RULES_SOURCE, rules, len);
+	UErrorCode	status = U_ZERO_ERROR;
+	int32_t		binary_len;
+	bytea	   *result;
 
-	ctxt->iter = ubrk_open(break_type, brk_locale, NULL, 0, &status);
+	binary_len = ubrk_getBinaryRules(brk, NULL, 0, &status);
 	if (U_FAILURE(status))
+		elog(ERROR, "ubrk_getBinaryRules failed: %s", u_errorName(status));
+
+	result = (bytea *) palloc(VARHDRSZ + binary_len);
+	binary_len = ubrk_getBinaryRules(brk, (uint8_t *) VARDATA(result),
+									 binary_len, &status);
+	if (U_FAILURE(status))
+		elog(ERROR, "ubrk_getBinaryRules failed: %s", u_errorName(status));
+	SET_VARSIZE(result, VARHDRSZ + binary_len);
+
+	return result;
+#else
+	elog(ERROR, "binary break rules require ICU 59 or newer");
+#endif
+}
+
+/*
+ * Categories of the rule statuses of word boundaries, by ranges of
+ * 100 values (see UWordBreak), as a bitmask of (1 << status/100).
+ */
+static const char *const word_status_names[] = {
+	"none",						/* UBRK_WORD_NONE: spaces, punctuation */
+	"number",					/* UBRK_WORD_NUMBER */
+	"letter",					/* UBRK_WORD_LETTER */
+	"kana",						/* UBRK_WORD_KANA */
+	"ideo"						/* UBRK_WORD_IDEO */
+};
+
+#define WORD_STATUS_CATEGORIES	lengthof(word_status_names)
+
+/* all the categories except "none" */
+#define WORD_STATUS_WORDS	(((1 << WORD_STATUS_CATEGORIES) - 1) & ~1)
+
+static inline bool
+word_status_accepted(int32_t status, int mask)
+{
+	int32_t category = status / 100;
+
+	return (category < WORD_STATUS_CATEGORIES && (mask & (1 << category)) != 0);
+}
+
+/*
+ * Return the mask of categories for an array of category names.
+ */
+static int
+word_status_mask(ArrayType *arr)
+{
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nitems;
+	int			mask = 0;
+
+	deconstruct_array(arr, TEXTOID, -1, false, 'i', &elems, &nulls, &nitems);
+
+	for (int i = 0; i < nitems; i++)
 	{
-		utext_close(ctxt->ut);
-		elog(ERROR, "ubrk_open failed: %s", u_errorName(status));
+		char	   *name;
+		int			c;
+
+		if (nulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("word status categories must not be null")));
+
+		name = TextDatumGetCString(elems[i]);
+		for (c = 0; c < WORD_STATUS_CATEGORIES; c++)
+		{
+			if (pg_strcasecmp(name, word_status_names[c]) == 0)
+				break;
+		}
+		if (c == WORD_STATUS_CATEGORIES)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid word status category: \"%s\"", name),
+					 errhint("Valid categories are none, number, letter, kana and ideo.")));
+		mask |= (1 << c);
 	}
+	return mask;
+}
 
-	ubrk_setUText(ctxt->iter, ctxt->ut, &status);
-	if (U_FAILURE(status))
+/*
+ * Split the input string (arg1) with a break iterator for the locale
+ * (arg2), or for the rules (arg2) if kind is BREAK_RULES_SOURCE, or
+ * for the rules named by arg2 if kind is BREAK_RULES_NAMED, returning
+ * the set of pieces in a tuplestore.
+ * The main difference between break iterators is:
+ * - UBRK_CHARACTER: return SETOF text
+ * - others: return SETOF (int,text), with the rule status
+ * For words, the optional arg3 gives the categories of rule statuses
+ * of the pieces to return, the others being skipped before being
+ * extracted.
+ */
+static Datum
+icu_boundaries_internal(int kind, PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *source_text = NULL;
+	UChar		local_buf[UCHAR_LOCAL_BUFSIZE];
+	UChar	   *cnv_text;	/* NULL if the database encoding is UTF-8 */
+	int32_t		len;
+	UBreakIterator *iter;
+	UText	   *ut;
+	Datum		values[2];
+	bool		nulls[2] = {false, false};
+	int32_t		pos0, pos1;
+	int			col;
+	int			mask = -1;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	if (kind != UBRK_CHARACTER)
 	{
-		ubrk_close(ctxt->iter);
-		utext_close(ctxt->ut);
-		elog(ERROR, "ubrk_setText() failed: %s", u_errorName(status));
+		/* Build a tuple descriptor for our result type */
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+	}
+	else
+	{
+#if PG_VERSION_NUM >= 120000
+		tupdesc = CreateTemplateTupleDesc(1);
+#else
+		tupdesc = CreateTemplateTupleDesc(1, false);
+#endif
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "icu_character_boundaries",
+						   TEXTOID, -1, 0);
+	}
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (kind == UBRK_WORD && PG_NARGS() > 2)
+		mask = word_status_mask(PG_GETARG_ARRAYTYPE_P(2));
+
+	/* open the iterator first, so that bad arguments are always reported */
+	iter = open_break_iterator_from_arg(kind, fcinfo);
+
+	len = VARSIZE_ANY_EXHDR(input);
+	if (len == 0)
+	{
+		ubrk_close(iter);
+		return (Datum) 0;		/* no result */
 	}
+
+	set_break_text(iter, VARDATA_ANY(input), len, local_buf, &ut, &cnv_text);
+	if (cnv_text == NULL)
+		source_text = VARDATA_ANY(input);
+
+	/* the piece of text goes in the last column */
+	col = (kind == UBRK_CHARACTER) ? 0 : 1;
+
+	for (pos0 = ubrk_first(iter);
+		 (pos1 = ubrk_next(iter)) != UBRK_DONE;
+		 pos0 = pos1)
+	{
+		int32_t		rule_status = ubrk_getRuleStatus(iter);
+
+		if (mask != -1 && !word_status_accepted(rule_status, mask))
+			continue;
+
+		if (source_text != NULL)
+			values[col] = PointerGetDatum(cstring_to_text_with_len(source_text + pos0,
+																   pos1 - pos0));
+		else
+		{
+			char *buf;
+			/* convert back UChar to a buffer in the database encoding */
+			int32_t blen = string_from_uchar(&buf, cnv_text + pos0, pos1 - pos0);
+			values[col] = PointerGetDatum(cstring_to_text_with_len(buf, blen));
+			pfree(buf);
+		}
+
+		if (col == 1)
+			values[0] = Int32GetDatum(rule_status);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		pfree(DatumGetPointer(values[col]));
+	}
+
+	ubrk_close(iter);
+	utext_close(ut);
+
+	return (Datum) 0;
 }
 
 /*
@@ -145,123 +626,614 @@ init_srf_first_call(UBreakIteratorType break_type, PG_FUNCTION_ARGS)
 Datum
 icu_character_boundaries(PG_FUNCTION_ARGS)
 {
-	FuncCallContext *funcctx;
-	int32_t pos0, pos;
-	struct ubreak_ctxt *ctxt;
+	return icu_boundaries_internal(UBRK_CHARACTER, fcinfo);
+}
+
+/*
+ * Return (tag,content) tuples
+ */
+Datum
+icu_word_boundaries(PG_FUNCTION_ARGS)
+{
+	return icu_boundaries_internal(UBRK_WORD, fcinfo);
+}
+
+Datum
+icu_line_boundaries(PG_FUNCTION_ARGS)
+{
+	return icu_boundaries_internal(UBRK_LINE, fcinfo);
+}
+
+Datum
+icu_sentence_boundaries(PG_FUNCTION_ARGS)
+{
+	return icu_boundaries_internal(UBRK_SENTENCE, fcinfo);
+}
+
+/*
+ * Count the pieces of the string split by a break iterator, only
+ * those having their rule status in @mask if it's not -1.
+ */
+static int32
+count_boundaries(UBreakIteratorType break_type, const char *locale,
+				 text *input, int mask)
+{
+	UChar		local_buf[UCHAR_LOCAL_BUFSIZE];
+	UChar	   *cnv_text;
+	UBreakIterator *iter;
+	UText	   *ut;
+	int32		count = 0;
 
-	if (SRF_IS_FIRSTCALL())
+	if (VARSIZE_ANY_EXHDR(input) == 0)
+		return 0;
+
+	iter = open_break_iterator(break_type, locale);
+	set_break_text(iter, VARDATA_ANY(input), VARSIZE_ANY_EXHDR(input),
+				   local_buf, &ut, &cnv_text);
+
+	while (ubrk_next(iter) != UBRK_DONE)
 	{
-		init_srf_first_call(UBRK_CHARACTER, fcinfo);
+		if (mask == -1 || word_status_accepted(ubrk_getRuleStatus(iter), mask))
+			count++;
 	}
 
-	funcctx = SRF_PERCALL_SETUP();
-	ctxt = (struct ubreak_ctxt*) funcctx->user_fctx;
+	ubrk_close(iter);
+	utext_close(ut);
+
+	return count;
+}
+
+/*
+ * Return the number of grapheme clusters (user-perceived characters)
+ * in the string.
+ */
+Datum
+icu_grapheme_count(PG_FUNCTION_ARGS)
+{
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *s = VARDATA_ANY(input);
+	int32		len = VARSIZE_ANY_EXHDR(input);
+
+	/* in ASCII, only CR-LF is a cluster of more than one character */
+	if (is_ascii_string(s, len) && memchr(s, '\r', len) == NULL)
+		PG_RETURN_INT32(len);
+
+	PG_RETURN_INT32(count_boundaries(UBRK_CHARACTER, "", input, -1));
+}
+
+/*
+ * Return the number of words in the string (arg1) according to the
+ * locale (arg2). Words are the pieces between word boundaries that
+ * are not spaces or punctuation, or that belong to the categories
+ * passed as the optional arg3.
+ */
+Datum
+icu_word_count(PG_FUNCTION_ARGS)
+{
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *locale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	int			mask = WORD_STATUS_WORDS;
+
+	if (PG_NARGS() > 2)
+		mask = word_status_mask(PG_GETARG_ARRAYTYPE_P(2));
+
+	PG_RETURN_INT32(count_boundaries(UBRK_WORD, locale, input, mask));
+}
+
+/*
+ * Return the number of sentences in the string (arg1) according to
+ * the locale (arg2).
+ */
+Datum
+icu_sentence_count(PG_FUNCTION_ARGS)
+{
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *locale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+
+	PG_RETURN_INT32(count_boundaries(UBRK_SENTENCE, locale, input, -1));
+}
+
+/*
+ * Return in *offsets the positions of the ends of the pieces of the
+ * string split by a break iterator, in characters or in bytes, and
+ * in *tags their rule statuses if tags is not NULL.
+ * No piece is extracted: the positions are computed from the offsets
+ * of the iterator, in bytes in UTF-8 and UTF-16 code units otherwise.
+ */
+static int
+collect_offsets(UBreakIteratorType break_type, const char *locale,
+				text *input, bool in_bytes, Datum **offsets, Datum **tags)
+{
+	UChar		local_buf[UCHAR_LOCAL_BUFSIZE];
+	UChar	   *cnv_text;
+	const char *s = VARDATA_ANY(input);
+	UBreakIterator *iter;
+	UText	   *ut;
+	int32_t		pos0 = 0, pos1;
+	int32		out_pos = 0;
+	int			count = 0;
+	int			allocated = 64;
+
+	*offsets = NULL;
+	if (tags != NULL)
+		*tags = NULL;
 
-	if (ctxt->len == 0)
-		SRF_RETURN_DONE(funcctx); /* no result */
+	if (VARSIZE_ANY_EXHDR(input) == 0)
+		return 0;
 
-	pos0 = ubrk_current(ctxt->iter);
-	pos = ubrk_next(ctxt->iter);
+	iter = open_break_iterator(break_type, locale);
+	set_break_text(iter, s, VARSIZE_ANY_EXHDR(input), local_buf, &ut, &cnv_text);
 
-	if (pos != UBRK_DONE)
+	*offsets = palloc(allocated * sizeof(Datum));
+	if (tags != NULL)
+		*tags = palloc(allocated * sizeof(Datum));
+
+	while ((pos1 = ubrk_next(iter)) != UBRK_DONE)
 	{
-		text *item;
-		if (ctxt->source_text != NULL)
-			item = cstring_to_text_with_len(ctxt->source_text+pos0, pos-pos0);
+		if (cnv_text == NULL)
+		{
+			if (in_bytes)
+				out_pos = pos1;
+			else
+			{
+				/* count the bytes that start a UTF-8 sequence */
+				for (int32_t i = pos0; i < pos1; i++)
+				{
+					if (((unsigned char) s[i] & 0xC0) != 0x80)
+						out_pos++;
+				}
+			}
+		}
+		else if (in_bytes)
+			out_pos += string_from_uchar_length(cnv_text + pos0, pos1 - pos0);
 		else
+			out_pos += u_countChar32(cnv_text + pos0, pos1 - pos0);
+
+		if (count == allocated)
 		{
-			char *buf;
-			/* convert UChar to a buffer in the database encoding */
-			int32_t len = string_from_uchar(&buf, ctxt->cnv_text+pos0, pos-pos0);
-			item = cstring_to_text_with_len(buf, len);
+			allocated *= 2;
+			*offsets = repalloc(*offsets, allocated * sizeof(Datum));
+			if (tags != NULL)
+				*tags = repalloc(*tags, allocated * sizeof(Datum));
 		}
-		SRF_RETURN_NEXT(funcctx, PointerGetDatum(item));
-	}
-	else	/* end of SRF iteration */
-	{
-		ubrk_close(ctxt->iter);
-		utext_close(ctxt->ut);
-		SRF_RETURN_DONE(funcctx);
+		(*offsets)[count] = Int32GetDatum(out_pos);
+		if (tags != NULL)
+			(*tags)[count] = Int32GetDatum(ubrk_getRuleStatus(iter));
+		count++;
+		pos0 = pos1;
 	}
+
+	ubrk_close(iter);
+	utext_close(ut);
+
+	return count;
 }
 
+static ArrayType *
+int4_array(Datum *elems, int count)
+{
+	if (count == 0)
+		return construct_empty_array(INT4OID);
+	return construct_array(elems, count, INT4OID, sizeof(int32), true, 'i');
+}
 
 /*
- * Return (tag,content) tuples
+ * Return the positions of the ends of the characters of the string
+ * (arg1) according to the locale (arg2), in characters, or in bytes
+ * if arg3 is true.
  */
+Datum
+icu_character_offsets(PG_FUNCTION_ARGS)
+{
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *locale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	bool		in_bytes = PG_GETARG_BOOL(2);
+	Datum	   *offsets;
+	int			count;
+
+	count = collect_offsets(UBRK_CHARACTER, locale, input, in_bytes,
+							&offsets, NULL);
+	PG_RETURN_ARRAYTYPE_P(int4_array(offsets, count));
+}
 
+/*
+ * Return (offsets, tags) with the positions of the ends of the pieces
+ * of the string (arg1) according to the locale (arg2), in characters,
+ * or in bytes if arg3 is true, and their rule statuses.
+ */
 static Datum
-icu_boundaries_internal(UBreakIteratorType break_type, PG_FUNCTION_ARGS)
+icu_offsets_internal(UBreakIteratorType break_type, PG_FUNCTION_ARGS)
+{
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *locale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	bool		in_bytes = PG_GETARG_BOOL(2);
+	TupleDesc	tupdesc;
+	Datum	   *offsets;
+	Datum	   *tags;
+	Datum		values[2];
+	bool		nulls[2] = {false, false};
+	int			count;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	count = collect_offsets(break_type, locale, input, in_bytes,
+							&offsets, &tags);
+
+	values[0] = PointerGetDatum(int4_array(offsets, count));
+	values[1] = PointerGetDatum(int4_array(tags, count));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc),
+													  values, nulls)));
+}
+
+Datum
+icu_word_offsets(PG_FUNCTION_ARGS)
 {
-	FuncCallContext *funcctx;
-	int32_t pos0, pos1;
-	struct ubreak_ctxt *ctxt;
+	return icu_offsets_internal(UBRK_WORD, fcinfo);
+}
 
-	if (SRF_IS_FIRSTCALL())
+Datum
+icu_line_offsets(PG_FUNCTION_ARGS)
+{
+	return icu_offsets_internal(UBRK_LINE, fcinfo);
+}
+
+Datum
+icu_sentence_offsets(PG_FUNCTION_ARGS)
+{
+	return icu_offsets_internal(UBRK_SENTENCE, fcinfo);
+}
+
+/*
+ * Split the string (arg1) with a break iterator compiled from rules
+ * (arg2), returning (tag, contents) tuples.
+ */
+Datum
+icu_boundaries_rules(PG_FUNCTION_ARGS)
+{
+	return icu_boundaries_internal(BREAK_RULES_SOURCE, fcinfo);
+}
+
+/*
+ * Same as icu_boundaries_rules() with the rules registered under a
+ * name (arg2) in the icu_break_rules table.
+ */
+Datum
+icu_boundaries_named_rules(PG_FUNCTION_ARGS)
+{
+	return icu_boundaries_internal(BREAK_RULES_NAMED, fcinfo);
+}
+
+/*
+ * Compile break rules (arg1) into their binary form.
+ */
+Datum
+icu_break_rules_compile(PG_FUNCTION_ARGS)
+{
+	text	   *rules = PG_GETARG_TEXT_PP(0);
+
+	PG_RETURN_BYTEA_P(break_rules_binary(VARDATA_ANY(rules),
+										 VARSIZE_ANY_EXHDR(rules)));
+}
+
+/*
+ * Trigger of the icu_break_rules table, setting the binary_rules and
+ * icu_version columns from the rules column on insert and update.
+ */
+Datum
+icu_break_rules_trigger(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	TupleDesc	tupdesc;
+	HeapTuple	tuple;
+	int			rules_attnum;
+	int			attnums[2];
+	Datum		values[2];
+	bool		nulls[2];
+	Datum		rules;
+	bool		isnull;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "icu_break_rules_trigger: not called by trigger manager");
+	if (!TRIGGER_FIRED_BEFORE(trigdata->tg_event) ||
+		!TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+		elog(ERROR, "icu_break_rules_trigger: must be fired before each row");
+
+	if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+		tuple = trigdata->tg_trigtuple;
+	else if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+		tuple = trigdata->tg_newtuple;
+	else
+		elog(ERROR, "icu_break_rules_trigger: must be fired by INSERT or UPDATE");
+
+	tupdesc = trigdata->tg_relation->rd_att;
+	rules_attnum = SPI_fnumber(tupdesc, "rules");
+	attnums[0] = SPI_fnumber(tupdesc, "binary_rules");
+	attnums[1] = SPI_fnumber(tupdesc, "icu_version");
+	if (rules_attnum <= 0 || attnums[0] <= 0 || attnums[1] <= 0)
+		elog(ERROR, "icu_break_rules_trigger: missing rules, binary_rules or icu_version column");
+
+	rules = SPI_getbinval(tuple, tupdesc, rules_attnum, &isnull);
+	if (isnull)
 	{
-		init_srf_first_call(break_type, fcinfo);
+		nulls[0] = nulls[1] = true;
+		values[0] = values[1] = (Datum) 0;
 	}
+	else
+	{
+		text	   *txt = DatumGetTextPP(rules);
+		UVersionInfo version;
+		char		buf[U_MAX_VERSION_STRING_LENGTH + 1];
 
-	funcctx = SRF_PERCALL_SETUP();
-	ctxt = (struct ubreak_ctxt*) funcctx->user_fctx;
+#if U_ICU_VERSION_MAJOR_NUM >= 59
+		values[0] = PointerGetDatum(break_rules_binary(VARDATA_ANY(txt),
+													   VARSIZE_ANY_EXHDR(txt)));
+		nulls[0] = false;
+#else
+		/* no binary form, but check the rules by compiling them */
+		break_iterator_template(BREAK_RULES_SOURCE, VARDATA_ANY(txt),
+								VARSIZE_ANY_EXHDR(txt));
+		values[0] = (Datum) 0;
+		nulls[0] = true;
+#endif
+		u_getVersion(version);
+		u_versionToString(version, buf);
+		values[1] = CStringGetTextDatum(buf);
+		nulls[1] = false;
+	}
 
-	if (ctxt->len == 0)
-		SRF_RETURN_DONE(funcctx); /* no result */
+	tuple = heap_modify_tuple_by_cols(tuple, tupdesc, 2, attnums, values, nulls);
 
-	pos0 = ubrk_current(ctxt->iter);
-	do {
-		pos1 = ubrk_next(ctxt->iter);
+	return PointerGetDatum(tuple);
+}
 
-		if (pos1 != UBRK_DONE)
-		{
-			Datum	values[2];
-			bool	nulls[2];
-			HeapTuple tuple;
-			text *item;
+/*
+ * Display width of a code point in a fixed-width font: 2 for East
+ * Asian wide and fullwidth characters, 0 for control, format and
+ * combining characters and for the medial and final Hangul jamos,
+ * 1 otherwise.
+ */
+static int
+char_display_width(UChar32 c)
+{
+	if (c < 0x7F)
+		return (c >= 0x20) ? 1 : 0;
 
-			if (ctxt->source_text != NULL)
-			{
-				item = cstring_to_text_with_len(ctxt->source_text + pos0, pos1-pos0);
-			}
-			else
-			{
-				char *buf;
-				/* convert back UChar to a buffer in the database encoding */
-				int32_t len = string_from_uchar(&buf, ctxt->cnv_text + pos0, pos1-pos0);
-				item = cstring_to_text_with_len(buf, len);
-			}
+	switch (u_charType(c))
+	{
+		case U_NON_SPACING_MARK:
+		case U_ENCLOSING_MARK:
+		case U_FORMAT_CHAR:
+		case U_CONTROL_CHAR:
+			return 0;
+		default:
+			break;
+	}
 
-			values[0] = Int32GetDatum(ubrk_getRuleStatus(ctxt->iter));
-			nulls[0] = false;
-			values[1] = PointerGetDatum(item);
-			nulls[1] = false;
+	switch (u_getIntPropertyValue(c, UCHAR_HANGUL_SYLLABLE_TYPE))
+	{
+		case U_HST_VOWEL_JAMO:
+		case U_HST_TRAILING_JAMO:
+			return 0;
+		default:
+			break;
+	}
 
-			tuple = heap_form_tuple(ctxt->tupdesc, values, nulls);
-			SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
-		}
+	switch (u_getIntPropertyValue(c, UCHAR_EAST_ASIAN_WIDTH))
+	{
+		case U_EA_WIDE:
+		case U_EA_FULLWIDTH:
+			return 2;
+		default:
+			return 1;
+	}
+}
 
-	} while (pos1 != UBRK_DONE);
+/*
+ * Return the display width of the piece between the iterator offsets
+ * @pos0 and @pos1, in UTF-8 in @s or in UTF-16 in @u if not NULL.
+ * *trail is set to the offset where the trailing white space of the
+ * piece starts, and *visible to the width of the piece before it.
+ */
+static int
+piece_display_width(const char *s, const UChar *u, int32_t pos0,
+					int32_t pos1, int32_t *trail, int *visible)
+{
+	int32_t		i = pos0;
+	int			width = 0;
+	UChar32		c;
+
+	*trail = pos0;
+	*visible = 0;
+
+	while (i < pos1)
+	{
+		if (u == NULL)
+			U8_NEXT((const uint8_t *) s, i, pos1, c);
+		else
+			U16_NEXT(u, i, pos1, c);
 
-	/* end of SRF iteration */
-	ubrk_close(ctxt->iter);
-	utext_close(ctxt->ut);
-	SRF_RETURN_DONE(funcctx);
+		width += char_display_width(c);
+		if (!u_isUWhiteSpace(c))
+		{
+			*trail = i;
+			*visible = width;
+		}
+	}
+	return width;
 }
 
-Datum
-icu_word_boundaries(PG_FUNCTION_ARGS)
+/*
+ * Compute the lines of @input wrapped at line break opportunities
+ * according to @locale, so that they do not exceed the display @width
+ * unless a single piece is wider.
+ * Hard breaks (newlines) always end a line, and the white space at
+ * the end of lines is left out.
+ * Return the number of lines, with *bounds set to their start and end
+ * offsets in bytes in the string, as consecutive pairs.
+ */
+static int
+wrap_text(text *input, int32 width, const char *locale, int32 **bounds)
 {
-	return icu_boundaries_internal(UBRK_WORD, fcinfo);
+	const char *s = VARDATA_ANY(input);
+	UChar		local_buf[UCHAR_LOCAL_BUFSIZE];
+	UChar	   *cnv_text;
+	UBreakIterator *iter;
+	UText	   *ut;
+	int32_t		pos0, pos1;
+	int32		b0 = 0, b1, btrail;
+	int32		line_start = 0, line_end = 0;
+	int			line_width = 0;
+	bool		line_empty = true;
+	int			count = 0;
+	int			allocated = 16;
+
+	if (width <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("width must be greater than zero")));
+
+	*bounds = NULL;
+	if (VARSIZE_ANY_EXHDR(input) == 0)
+		return 0;
+
+	iter = open_break_iterator(UBRK_LINE, locale);
+	set_break_text(iter, s, VARSIZE_ANY_EXHDR(input), local_buf, &ut, &cnv_text);
+
+	*bounds = palloc(2 * allocated * sizeof(int32));
+
+#define ADD_LINE(start, end) \
+	do { \
+		if (count == allocated) \
+		{ \
+			allocated *= 2; \
+			*bounds = repalloc(*bounds, 2 * allocated * sizeof(int32)); \
+		} \
+		(*bounds)[2 * count] = (start); \
+		(*bounds)[2 * count + 1] = (end); \
+		count++; \
+	} while (0)
+
+	for (pos0 = ubrk_first(iter);
+		 (pos1 = ubrk_next(iter)) != UBRK_DONE;
+		 pos0 = pos1)
+	{
+		int32_t		trail;
+		int			visible;
+		int			piece_width;
+		int32_t		status = ubrk_getRuleStatus(iter);
+
+		piece_width = piece_display_width(s, cnv_text, pos0, pos1,
+										  &trail, &visible);
+
+		/* offsets in bytes of the end of the piece and of its trailing space */
+		if (cnv_text == NULL)
+		{
+			btrail = trail;
+			b1 = pos1;
+		}
+		else
+		{
+			btrail = b0 + string_from_uchar_length(cnv_text + pos0, trail - pos0);
+			b1 = btrail + string_from_uchar_length(cnv_text + trail, pos1 - trail);
+		}
+
+		/* move the piece to a new line if it does not fit */
+		if (!line_empty && line_width + visible > width)
+		{
+			ADD_LINE(line_start, line_end);
+			line_start = line_end = b0;
+			line_width = 0;
+			line_empty = true;
+		}
+
+		if (btrail > b0)
+		{
+			line_end = btrail;
+			line_empty = false;
+		}
+		line_width += piece_width;
+
+		if (status >= UBRK_LINE_HARD && status < UBRK_LINE_HARD_LIMIT)
+		{
+			ADD_LINE(line_start, line_end);
+			line_start = line_end = b1;
+			line_width = 0;
+			line_empty = true;
+		}
+		b0 = b1;
+	}
+
+	if (!line_empty)
+		ADD_LINE(line_start, line_end);
+
+#undef ADD_LINE
+
+	ubrk_close(iter);
+	utext_close(ut);
+
+	return count;
 }
 
+/*
+ * Wrap the string (arg1) into lines that fit in a display width
+ * (arg2) according to the locale (arg3), and return them separated
+ * by newlines.
+ */
 Datum
-icu_line_boundaries(PG_FUNCTION_ARGS)
+icu_wrap(PG_FUNCTION_ARGS)
 {
-	return icu_boundaries_internal(UBRK_LINE, fcinfo);
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *s = VARDATA_ANY(input);
+	int32	   *bounds;
+	int			count;
+	int			len = 0;
+	text	   *result;
+	char	   *p;
+
+	count = wrap_text(input, PG_GETARG_INT32(1),
+					  text_to_cstring(PG_GETARG_TEXT_PP(2)), &bounds);
+	for (int i = 0; i < count; i++)
+		len += bounds[2 * i + 1] - bounds[2 * i] + 1;
+	if (count > 0)
+		len--;					/* no newline after the last line */
+
+	result = (text *) palloc(VARHDRSZ + len);
+	SET_VARSIZE(result, VARHDRSZ + len);
+	p = VARDATA(result);
+	for (int i = 0; i < count; i++)
+	{
+		if (i > 0)
+			*p++ = '\n';
+		memcpy(p, s + bounds[2 * i], bounds[2 * i + 1] - bounds[2 * i]);
+		p += bounds[2 * i + 1] - bounds[2 * i];
+	}
+
+	PG_RETURN_TEXT_P(result);
 }
 
+/*
+ * Same as icu_wrap(), returning the lines as an array.
+ */
 Datum
-icu_sentence_boundaries(PG_FUNCTION_ARGS)
+icu_wrap_lines(PG_FUNCTION_ARGS)
 {
-	return icu_boundaries_internal(UBRK_SENTENCE, fcinfo);
+	text	   *input = PG_GETARG_TEXT_PP(0);
+	const char *s = VARDATA_ANY(input);
+	int32	   *bounds;
+	int			count;
+	Datum	   *lines;
+
+	count = wrap_text(input, PG_GETARG_INT32(1),
+					  text_to_cstring(PG_GETARG_TEXT_PP(2)), &bounds);
+	if (count == 0)
+		PG_RETURN_ARRAYTYPE_P(construct_empty_array(TEXTOID));
+
+	lines = palloc(count * sizeof(Datum));
+	for (int i = 0; i < count; i++)
+		lines[i] = PointerGetDatum(cstring_to_text_with_len(s + bounds[2 * i],
+															bounds[2 * i + 1] - bounds[2 * i]));
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(lines, count, TEXTOID, -1, false, 'i'));
 }
@@ -113,6 +113,7 @@ format_timestamp(TimestampTz pg_tstz, text *date_fmt, const char *locale)
 				   &status);
 	if (U_FAILURE(status))
 		elog(ERROR, "udat_open failed with code %d\n", status);
+	ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 
 	{
 		/* Try first to convert into a buffer on the stack, and
@@ -203,6 +204,7 @@ format_date(DateADT pg_date, text *date_fmt, const char *locale)
 				   &status);
 	if (U_FAILURE(status))
 		elog(ERROR, "udat_open failed with code %d\n", status);
+	ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 
 	{
 		/* Try first to convert into a buffer on the stack, and
@@ -338,6 +340,7 @@ parse_timestamp(const text *input_date,
 		udat_close(df);
 		elog(ERROR, "udat_open failed: %s\n", u_errorName(status));
 	}
+	ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 
 	udat_setLenient(df, false);	/* strict parsing */
 
@@ -458,6 +461,7 @@ icu_date_in(PG_FUNCTION_ARGS)
 		udat_close(df);
 		elog(ERROR, "udat_open failed: %s\n", u_errorName(status));
 	}
+	ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 
 	udat_setLenient(df, false);	/* strict parsing */
 
@@ -542,6 +546,7 @@ icu_date_out(PG_FUNCTION_ARGS)
 					   &status);
 		if (U_FAILURE(status))
 			elog(ERROR, "udat_open failed with code %d\n", status);
+		ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 		{
 			/* Try first to convert into a buffer on the stack, and
 			   palloc() it only if udat_format says it's too small */
@@ -10,22 +10,37 @@
 #include "icu_ext.h"
 
 #include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#else
+#include "access/hash.h"
+#endif
 #include "funcapi.h"
+#include "lib/hyperloglog.h"
+#include "lib/ilist.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "mb/pg_wchar.h"
+#include "port/pg_bswap.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/pg_locale.h"
+#include "utils/sortsupport.h"
 #include "utils/tuplestore.h"
 
 #include "unicode/ucnv.h"
 #include "unicode/ucol.h"
 #include "unicode/udat.h"
+#include "unicode/uiter.h"
 #include "unicode/uloc.h"
 #include "unicode/umachine.h"
 #include "unicode/uscript.h"
 #include "unicode/ustring.h"
+#include "unicode/utf16.h"
+#include "unicode/utf8.h"
 #include "unicode/utext.h"
 #include "unicode/uvernum.h"
 
@@ -39,9 +54,27 @@ PG_FUNCTION_INFO_V1(icu_default_locale);
 PG_FUNCTION_INFO_V1(icu_set_default_locale);
 PG_FUNCTION_INFO_V1(icu_compare);
 PG_FUNCTION_INFO_V1(icu_compare_coll);
+PG_FUNCTION_INFO_V1(icu_compare_rules);
 PG_FUNCTION_INFO_V1(icu_case_compare);
+PG_FUNCTION_INFO_V1(icu_text_lt);
+PG_FUNCTION_INFO_V1(icu_text_le);
+PG_FUNCTION_INFO_V1(icu_text_eq);
+PG_FUNCTION_INFO_V1(icu_text_ne);
+PG_FUNCTION_INFO_V1(icu_text_ge);
+PG_FUNCTION_INFO_V1(icu_text_gt);
+PG_FUNCTION_INFO_V1(icu_text_sortsupport);
+PG_FUNCTION_INFO_V1(icu_sortkey_sortsupport);
 PG_FUNCTION_INFO_V1(icu_sort_key);
 PG_FUNCTION_INFO_V1(icu_sort_key_coll);
+PG_FUNCTION_INFO_V1(icu_sort_key_rules);
+PG_FUNCTION_INFO_V1(icu_sort_key_prefix);
+PG_FUNCTION_INFO_V1(icu_sort_key_prefix_coll);
+PG_FUNCTION_INFO_V1(icu_sort_keys);
+PG_FUNCTION_INFO_V1(icu_sort_keys_coll);
+PG_FUNCTION_INFO_V1(icu_hash);
+PG_FUNCTION_INFO_V1(icu_hash_coll);
+PG_FUNCTION_INFO_V1(icu_hash_extended);
+PG_FUNCTION_INFO_V1(icu_hash_extended_coll);
 PG_FUNCTION_INFO_V1(icu_char_name);
 PG_FUNCTION_INFO_V1(icu_char_type);
 PG_FUNCTION_INFO_V1(icu_char_ublock_id);
@@ -57,6 +90,7 @@ char *icu_ext_timestamptz_format;
 /* Built-in ICU styles that are #define'd. See date_format_style() */
 UDateFormatStyle icu_ext_date_style = UDAT_DEFAULT;
 UDateFormatStyle icu_ext_timestamptz_style = UDAT_DEFAULT;
+int icu_ext_collator_cache_size = 8;
 
 static const char* general_category_types[] = {
 	"Cn",
@@ -79,6 +113,55 @@ void		_PG_init(void);
  */
 static UConverter *icu_converter = NULL;
 
+/*
+ * With single-byte database encodings, the conversions are done with
+ * lookup tables built from the converter: from each byte to its UChar,
+ * and from each UChar to its byte, 0 meaning that the UChar has
+ * no simple mapping (except for U+0000). These are NULL if the
+ * encoding is not single-byte or has bytes not mapping to one UChar.
+ */
+static UChar *sb_to_uchar = NULL;
+static uint8 *sb_from_uchar = NULL;
+
+static void
+init_single_byte_tables(UConverter *conv)
+{
+	UChar	   *to_table;
+	uint8	   *from_table;
+
+	to_table = MemoryContextAlloc(TopMemoryContext, 256 * sizeof(UChar));
+	from_table = MemoryContextAllocZero(TopMemoryContext, 65536);
+
+	for (int b = 0; b < 256; b++)
+	{
+		char		c = (char) b;
+		char		back[4];
+		UChar		u[2];
+		int32_t		ulen,
+					blen;
+		UErrorCode	status = U_ZERO_ERROR;
+
+		ulen = ucnv_toUChars(conv, u, lengthof(u), &c, 1, &status);
+		if (U_FAILURE(status) || ulen != 1)
+		{
+			/* not a 1:1 mapping, keep using the converter */
+			pfree(to_table);
+			pfree(from_table);
+			return;
+		}
+		to_table[b] = u[0];
+
+		/* only keep the reverse mappings that the converter agrees with */
+		status = U_ZERO_ERROR;
+		blen = ucnv_fromUChars(conv, back, sizeof(back), u, 1, &status);
+		if (U_SUCCESS(status) && blen == 1 && (uint8) back[0] == b)
+			from_table[u[0]] = (uint8) b;
+	}
+
+	sb_to_uchar = to_table;
+	sb_from_uchar = from_table;
+}
+
 static void
 init_icu_converter(void)
 {
@@ -103,6 +186,9 @@ init_icu_converter(void)
 				(errmsg("could not open ICU converter for encoding \"%s\": %s",
 						icu_encoding_name, u_errorName(status))));
 
+	if (pg_encoding_max_length(GetDatabaseEncoding()) == 1)
+		init_single_byte_tables(conv);
+
 	icu_converter = conv;
 }
 
@@ -125,6 +211,150 @@ uchar_length(UConverter *converter, const char *str, int32_t len)
 }
 
 
+/*
+ * Conversions between UTF-8 and UTF-16 for UTF-8 databases, in a single
+ * pass into buffers sized for the worst case: a UTF-8 string never has
+ * more UTF-16 code units than bytes, and a UTF-16 code unit never needs
+ * more than 3 bytes in UTF-8.
+ * Runs of ASCII characters, which are the most common by far, are
+ * detected and copied a word at a time, and only the other characters
+ * are decoded one by one.
+ */
+#define ASCII_WORD_MASK		UINT64CONST(0x8080808080808080)
+#define ASCII_UWORD_MASK	UINT64CONST(0xFF80FF80FF80FF80)
+
+/*
+ * Return true if the @len bytes at @s are all ASCII characters.
+ */
+bool
+is_ascii_string(const char *s, size_t len)
+{
+	size_t		i = 0;
+
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64		chunk;
+
+		memcpy(&chunk, s + i, sizeof(chunk));
+		if (chunk & ASCII_WORD_MASK)
+			return false;
+	}
+	for (; i < len; i++)
+	{
+		if ((unsigned char) s[i] >= 0x80)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Convert @nbytes of UTF-8 at @src into @dest, which must have room
+ * for @nbytes + 1 UChars. Return the number of UChars, not counting
+ * the terminating zero.
+ */
+static int32_t
+utf8_to_uchar(UChar *dest, const char *src, int32_t nbytes)
+{
+	const uint8_t *s = (const uint8_t *) src;
+	int32_t		i = 0;
+	int32_t		j = 0;
+
+	while (i < nbytes)
+	{
+		/* ASCII run, by words of 8 bytes then byte by byte */
+		while (i + 8 <= nbytes)
+		{
+			uint64		chunk;
+
+			memcpy(&chunk, s + i, sizeof(chunk));
+			if (chunk & ASCII_WORD_MASK)
+				break;
+			for (int k = 0; k < 8; k++)
+				dest[j + k] = s[i + k];
+			i += 8;
+			j += 8;
+		}
+		while (i < nbytes && s[i] < 0x80)
+			dest[j++] = s[i++];
+
+		/* non-ASCII run */
+		while (i < nbytes && s[i] >= 0x80)
+		{
+			UChar32		c;
+
+			U8_NEXT(s, i, nbytes, c);
+			if (c < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
+						 errmsg("invalid byte sequence for encoding \"UTF8\"")));
+			U16_APPEND_UNSAFE(dest, j, c);
+		}
+	}
+	dest[j] = 0;
+
+	return j;
+}
+
+/*
+ * Convert @len_uchar UChars at @src into UTF-8 into @dest, which must
+ * have room for 3 * @len_uchar + 1 bytes. Return the number of bytes,
+ * not counting the terminating zero.
+ * Unpaired surrogates are replaced by U+FFFD, like ucnv_fromUChars()
+ * would do.
+ */
+static int32_t
+uchar_to_utf8(char *dest, const UChar *src, int32_t len_uchar)
+{
+	int32_t		i = 0;
+	int32_t		j = 0;
+
+	while (i < len_uchar)
+	{
+		int32_t		start;
+		int32_t		out_len;
+		UErrorCode	status = U_ZERO_ERROR;
+
+		/* ASCII run, by words of 4 UChars then one by one */
+		while (i + 4 <= len_uchar)
+		{
+			uint64		chunk;
+
+			memcpy(&chunk, src + i, sizeof(chunk));
+			if (chunk & ASCII_UWORD_MASK)
+				break;
+			for (int k = 0; k < 4; k++)
+				dest[j + k] = (char) src[i + k];
+			i += 4;
+			j += 4;
+		}
+		while (i < len_uchar && src[i] < 0x80)
+			dest[j++] = (char) src[i++];
+
+		if (i >= len_uchar)
+			break;
+
+		/*
+		 * Non-ASCII run, up to the next ASCII character. Since ASCII
+		 * characters are never part of surrogate pairs, this never
+		 * splits a pair.
+		 */
+		start = i;
+		while (i < len_uchar && src[i] >= 0x80)
+			i++;
+		u_strToUTF8WithSub(dest + j, 3 * (i - start), &out_len,
+						   src + start, i - start,
+						   0xFFFD, NULL, &status);
+		if (U_FAILURE(status))
+			ereport(ERROR,
+					(errmsg("%s failed: %s", "u_strToUTF8WithSub",
+							u_errorName(status))));
+		j += out_len;
+	}
+	dest[j] = '\0';
+
+	return j;
+}
+
 /*
  * Convert a string in the database encoding into a string of UChars.
  *
@@ -143,8 +373,26 @@ string_to_uchar(UChar **buff_uchar, const char *buff, size_t nbytes)
 	UErrorCode	status = U_ZERO_ERROR;
 	int32_t		len_uchar;
 
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		*buff_uchar = palloc((nbytes + 1) * sizeof(**buff_uchar));
+		len_uchar = utf8_to_uchar(*buff_uchar, buff, nbytes);
+		ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+		return len_uchar;
+	}
+
 	init_icu_converter();
 
+	if (sb_to_uchar != NULL)
+	{
+		*buff_uchar = palloc((nbytes + 1) * sizeof(**buff_uchar));
+		for (size_t i = 0; i < nbytes; i++)
+			(*buff_uchar)[i] = sb_to_uchar[(uint8) buff[i]];
+		(*buff_uchar)[nbytes] = 0;
+		ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+		return nbytes;
+	}
+
 	len_uchar = uchar_length(icu_converter, buff, nbytes);
 
 	*buff_uchar = palloc((len_uchar + 1) * sizeof(**buff_uchar));
@@ -159,9 +407,130 @@ string_to_uchar(UChar **buff_uchar, const char *buff, size_t nbytes)
 		ereport(ERROR,
 				(errmsg("%s failed: %s", "ucnv_toUChars", u_errorName(status))));
 
+	ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+
+	return len_uchar;
+}
+
+/*
+ * Convert a string in the database encoding into a caller-supplied
+ * buffer of @buf_size UChars, which must be large enough for the
+ * result and its terminating nul. Since the number of UTF-16 code
+ * units never exceeds the number of bytes in the source,
+ * @nbytes + 1 is always enough.
+ * Return the number of UChars generated.
+ */
+int32_t
+string_to_uchar_buffer(UChar *buf, int32_t buf_size, const char *buff, size_t nbytes)
+{
+	UErrorCode	status = U_ZERO_ERROR;
+	int32_t		len_uchar;
+
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		Assert(buf_size > nbytes);
+		len_uchar = utf8_to_uchar(buf, buff, nbytes);
+		ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+		return len_uchar;
+	}
+
+	init_icu_converter();
+
+	if (sb_to_uchar != NULL)
+	{
+		Assert(buf_size > nbytes);
+		for (size_t i = 0; i < nbytes; i++)
+			buf[i] = sb_to_uchar[(uint8) buff[i]];
+		buf[nbytes] = 0;
+		ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+		return nbytes;
+	}
+
+	len_uchar = ucnv_toUChars(icu_converter,
+							  buf,
+							  buf_size,
+							  buff,
+							  nbytes,
+							  &status);
+	if (U_FAILURE(status))
+		ereport(ERROR,
+				(errmsg("%s failed: %s", "ucnv_toUChars", u_errorName(status))));
+
+	ICU_EXT_COUNT(ICU_STAT_BYTES_TO_UCHAR, nbytes);
+
 	return len_uchar;
 }
 
+/*
+ * Per-backend scratch buffers for the UTF-16 strings that functions
+ * only need during their call, reused from one call to the next
+ * instead of being palloc'ed for each row.
+ * Each function uses distinct slots for the buffers it needs at the
+ * same time, and must not use the contents after returning.
+ * A buffer grown above UCHAR_SCRATCH_MAX_SIZE UChars is released as
+ * soon as a smaller size is requested from its slot, to avoid holding
+ * large amounts of memory for the rest of the session.
+ */
+#define UCHAR_SCRATCH_MAX_SIZE	(1024 * 1024)
+
+static UChar *uchar_scratch[UCHAR_SCRATCH_SLOTS];
+static int32_t uchar_scratch_size[UCHAR_SCRATCH_SLOTS];
+
+/*
+ * Return the scratch buffer @slot with room for at least @size UChars.
+ * Its previous contents are not preserved.
+ */
+UChar *
+uchar_scratch_buffer(int slot, int32_t size)
+{
+	Assert(slot >= 0 && slot < UCHAR_SCRATCH_SLOTS);
+
+	if (uchar_scratch_size[slot] > UCHAR_SCRATCH_MAX_SIZE &&
+		size <= UCHAR_SCRATCH_MAX_SIZE)
+	{
+		pfree(uchar_scratch[slot]);
+		uchar_scratch[slot] = NULL;
+		uchar_scratch_size[slot] = 0;
+	}
+
+	if (size > uchar_scratch_size[slot])
+	{
+		int32_t		new_size = Max(uchar_scratch_size[slot], UCHAR_LOCAL_BUFSIZE);
+
+		while (new_size < size)
+			new_size = (new_size > UCHAR_SCRATCH_MAX_SIZE / 2) ? size : new_size * 2;
+		if (uchar_scratch[slot] != NULL)
+			pfree(uchar_scratch[slot]);
+		uchar_scratch[slot] = MemoryContextAlloc(TopMemoryContext,
+												 new_size * sizeof(UChar));
+		uchar_scratch_size[slot] = new_size;
+	}
+	return uchar_scratch[slot];
+}
+
+/*
+ * Like string_to_uchar(), but convert into @local_buf, an array of
+ * UCHAR_LOCAL_BUFSIZE UChars typically on the caller's stack, when
+ * the string is short enough, and otherwise into the scratch buffer
+ * @slot. *dest receives a pointer to the result, which must not
+ * be pfree'd.
+ */
+int32_t
+string_to_uchar_scratch(UChar **dest, UChar *local_buf, int slot,
+						const char *buff, size_t nbytes)
+{
+	UChar	   *buf;
+	int32_t		buf_size = nbytes + 1;
+
+	if (buf_size <= UCHAR_LOCAL_BUFSIZE)
+		buf = local_buf;
+	else
+		buf = uchar_scratch_buffer(slot, buf_size);
+
+	*dest = buf;
+	return string_to_uchar_buffer(buf, buf_size, buff, nbytes);
+}
+
 /*
  * Convert a string of UChars into the database encoding.
  *
@@ -179,8 +548,41 @@ string_from_uchar(char **result, const UChar *buff_uchar, int32_t len_uchar)
 	UErrorCode	status;
 	int32_t		len_result;
 
+	if (GetDatabaseEncoding() == PG_UTF8 &&
+		len_uchar >= 0 && (Size) len_uchar * 3 + 1 <= MaxAllocSize)
+	{
+		*result = palloc((Size) len_uchar * 3 + 1);
+		len_result = uchar_to_utf8(*result, buff_uchar, len_uchar);
+		ICU_EXT_COUNT(ICU_STAT_BYTES_FROM_UCHAR, len_result);
+		return len_result;
+	}
+
 	init_icu_converter();
 
+	if (sb_from_uchar != NULL && len_uchar >= 0)
+	{
+		char	   *dest = palloc(len_uchar + 1);
+		int32_t		i;
+
+		for (i = 0; i < len_uchar; i++)
+		{
+			UChar		u = buff_uchar[i];
+
+			if (sb_from_uchar[u] == 0 && u != 0)
+				break;			/* no simple mapping */
+			dest[i] = (char) sb_from_uchar[u];
+		}
+		if (i == len_uchar)
+		{
+			dest[len_uchar] = '\0';
+			*result = dest;
+			ICU_EXT_COUNT(ICU_STAT_BYTES_FROM_UCHAR, len_uchar);
+			return len_uchar;
+		}
+		/* let the converter deal with the characters outside of the table */
+		pfree(dest);
+	}
+
 	status = U_ZERO_ERROR;
 	len_result = ucnv_fromUChars(icu_converter, NULL, 0,
 								 buff_uchar, len_uchar, &status);
@@ -200,6 +602,58 @@ string_from_uchar(char **result, const UChar *buff_uchar, int32_t len_uchar)
 				(errmsg("%s failed: %s", "ucnv_fromUChars",
 						u_errorName(status))));
 
+	ICU_EXT_COUNT(ICU_STAT_BYTES_FROM_UCHAR, len_result);
+
+	return len_result;
+}
+
+/*
+ * Return the number of bytes that string_from_uchar() would produce
+ * for the UTF-16 string, without converting it.
+ */
+int32_t
+string_from_uchar_length(const UChar *buff_uchar, int32_t len_uchar)
+{
+	UErrorCode	status = U_ZERO_ERROR;
+	int32_t		len_result;
+
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		int32_t		i = 0;
+
+		len_result = 0;
+		while (i < len_uchar)
+		{
+			UChar32		c;
+
+			U16_NEXT(buff_uchar, i, len_uchar, c);
+			/* lone surrogates become U+FFFD, also 3 bytes long */
+			len_result += U8_LENGTH(c);
+		}
+		return len_result;
+	}
+
+	init_icu_converter();
+
+	if (sb_from_uchar != NULL)
+	{
+		int32_t		i;
+
+		for (i = 0; i < len_uchar; i++)
+		{
+			if (sb_from_uchar[buff_uchar[i]] == 0 && buff_uchar[i] != 0)
+				break;			/* no simple mapping */
+		}
+		if (i == len_uchar)
+			return len_uchar;
+	}
+
+	len_result = ucnv_fromUChars(icu_converter, NULL, 0,
+								 buff_uchar, len_uchar, &status);
+	if (U_FAILURE(status) && status != U_BUFFER_OVERFLOW_ERROR)
+		ereport(ERROR,
+				(errmsg("%s failed: %s", "ucnv_fromUChars",
+						u_errorName(status))));
 	return len_result;
 }
 
@@ -285,6 +739,7 @@ icu_collation_attributes(PG_FUNCTION_ARGS)
 	if (!collator) {
 		elog(ERROR, "failed to open collation");
 	}
+	ICU_EXT_COUNT(ICU_STAT_UCOL_OPEN, 1);
 
 	tupstore = tuplestore_begin_heap(true, false, work_mem);
 	rsinfo->returnMode = SFRM_Materialize;
@@ -775,18 +1230,198 @@ ucollator_from_coll_id(Oid collid)
 	return pg_locale->info.icu.ucol;
 }
 
+/*
+ * Per-backend cache of the UCollator objects opened by the functions
+ * taking an ICU locale as an explicit argument (icu_compare_coll,
+ * icu_sort_key_coll, icu_strpos_coll, icu_replace_coll...), or built
+ * from tailoring rules (icu_compare_rules, icu_sort_key_rules).
+ * The entries are kept in most-recently-used order, and the least
+ * recently used collator is closed when the cache grows over
+ * icu_ext.collator_cache_size entries.
+ */
+typedef struct collator_cache_entry
+{
+	dlist_node	node;
+	bool		from_rules;		/* key: locale name or tailoring rules */
+	uint32		hash;			/* hash of the key */
+	int			keylen;
+	char	   *key;			/* not NUL-terminated */
+	UCollator  *collator;
+} collator_cache_entry;
+
+static dlist_head collator_cache = DLIST_STATIC_INIT(collator_cache);
+static int collator_cache_count = 0;
+
+/* Close and forget the least recently used collators beyond max_entries */
+static void
+collator_cache_trim(int max_entries)
+{
+	while (collator_cache_count > max_entries)
+	{
+		collator_cache_entry *entry;
+
+		entry = dlist_container(collator_cache_entry, node,
+								dlist_tail_node(&collator_cache));
+		dlist_delete(&entry->node);
+		collator_cache_count--;
+		ucol_close(entry->collator);
+		pfree(entry->key);
+		pfree(entry);
+	}
+}
+
+/*
+ * Return the cached collator for the key, or NULL if there is none.
+ * The entry found becomes the most recently used.
+ */
+static UCollator*
+collator_cache_lookup(bool from_rules, const char *key, int keylen,
+					  uint32 hash)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &collator_cache)
+	{
+		collator_cache_entry *entry;
+
+		entry = dlist_container(collator_cache_entry, node, iter.cur);
+		if (entry->hash == hash &&
+			entry->from_rules == from_rules &&
+			entry->keylen == keylen &&
+			memcmp(entry->key, key, keylen) == 0)
+		{
+			dlist_move_head(&collator_cache, &entry->node);
+			ICU_EXT_COUNT(ICU_STAT_COLLATOR_CACHE_HIT, 1);
+			return entry->collator;
+		}
+	}
+	ICU_EXT_COUNT(ICU_STAT_COLLATOR_CACHE_MISS, 1);
+	return NULL;
+}
+
+/* Add a newly opened collator to the cache, evicting the oldest one if full */
+static void
+collator_cache_insert(bool from_rules, const char *key, int keylen,
+					  uint32 hash, UCollator *collator)
+{
+	collator_cache_entry *entry;
+
+	/* make room for the new entry */
+	collator_cache_trim(icu_ext_collator_cache_size - 1);
+
+	entry = MemoryContextAlloc(TopMemoryContext, sizeof(collator_cache_entry));
+	entry->from_rules = from_rules;
+	entry->hash = hash;
+	entry->keylen = keylen;
+	entry->key = MemoryContextAlloc(TopMemoryContext, keylen);
+	memcpy(entry->key, key, keylen);
+	entry->collator = collator;
+	dlist_push_head(&collator_cache, &entry->node);
+	collator_cache_count++;
+}
+
+/*
+ * Get a UCollator object for the ICU locale in input, opening it
+ * if it's not already in the cache.
+ * The result is owned by the cache: callers must not close or
+ * modify it, and must not use it past the current function call,
+ * since it may be closed when other collators get opened.
+ */
+UCollator*
+ucollator_from_locale(const char *locname)
+{
+	int			len = strlen(locname);
+	uint32		hash = DatumGetUInt32(hash_any((const unsigned char *) locname, len));
+	UCollator  *collator;
+	UErrorCode	status = U_ZERO_ERROR;
+
+	collator = collator_cache_lookup(false, locname, len, hash);
+	if (collator != NULL)
+		return collator;
+
+	collator = ucol_open(locname, &status);
+	if (!collator || U_FAILURE(status))
+		elog(ERROR, "failed to open collation: %s", u_errorName(status));
+	ICU_EXT_COUNT(ICU_STAT_UCOL_OPEN, 1);
+
+	collator_cache_insert(false, locname, len, hash, collator);
+
+	return collator;
+}
+
+/*
+ * Get a UCollator object built from ICU tailoring rules, compiling
+ * them only if they're not already in the cache.
+ * The same restrictions as for ucollator_from_locale() apply
+ * to the result.
+ */
+UCollator*
+ucollator_from_rules(text *rules)
+{
+	const char *key = VARDATA_ANY(rules);
+	int			len = VARSIZE_ANY_EXHDR(rules);
+	uint32		hash = DatumGetUInt32(hash_any((const unsigned char *) key, len));
+	UCollator  *collator;
+	UChar	   *urules;
+	int32_t		ulen;
+	UParseError	parse_error;
+	UErrorCode	status = U_ZERO_ERROR;
+
+	collator = collator_cache_lookup(true, key, len, hash);
+	if (collator != NULL)
+		return collator;
+
+	ulen = string_to_uchar(&urules, key, len);
+	collator = ucol_openRules(urules, ulen,
+							  UCOL_DEFAULT, UCOL_DEFAULT_STRENGTH,
+							  &parse_error, &status);
+	pfree(urules);
+	if (!collator || U_FAILURE(status))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("failed to compile collation rules: %s",
+						u_errorName(status)),
+				 parse_error.offset >= 0 ?
+				 errdetail("The error is at offset %d of the rules.",
+						   parse_error.offset) : 0));
+	}
+	ICU_EXT_COUNT(ICU_STAT_UCOL_OPEN, 1);
+
+	collator_cache_insert(true, key, len, hash, collator);
+
+	return collator;
+}
+
+static void
+assign_guc_collator_cache_size(int newval, void *extra)
+{
+	collator_cache_trim(newval);
+}
+
 /*
  * The actual collation-aware comparison happens here.
  * the UCollator comes either from a cached pg_locale_t
- * or is just opened and closed immediately by icu_ext.
+ * or from the cache of collators opened by icu_ext.
+ *
+ * The strings are compared where they are, without copying them.
+ * Byte-identical strings are always equal whatever the collation,
+ * so this case skips ICU entirely. Otherwise ICU itself skips the
+ * common prefix of the strings (backing up to a safe boundary for
+ * contractions and combining sequences) and uses its fast Latin
+ * tables when possible.
  */
 static UCollationResult
 our_strcoll(text *txt1, text *txt2, UCollator *collator )
 {
 	UCollationResult result;
+	const char *str1 = VARDATA_ANY(txt1);
+	const char *str2 = VARDATA_ANY(txt2);
 	int32_t len1 = VARSIZE_ANY_EXHDR(txt1);
 	int32_t len2 = VARSIZE_ANY_EXHDR(txt2);
 
+	if (len1 == len2 && memcmp(str1, str2, len1) == 0)
+		return UCOL_EQUAL;
 
 	if (GetDatabaseEncoding() == PG_UTF8)
 	{
@@ -794,26 +1429,26 @@ our_strcoll(text *txt1, text *txt2, UCollator *collator )
 		UErrorCode	status = U_ZERO_ERROR;
 
 		result = ucol_strcollUTF8(collator,
-								  text_to_cstring(txt1), len1,
-								  text_to_cstring(txt2), len2,
+								  str1, len1,
+								  str2, len2,
 								  &status);
 		if (U_FAILURE(status))
 			elog(ERROR, "ICU strcoll failed: %s", u_errorName(status));
 	}
 	else
 	{
-		int32_t ulen1, ulen2;
+		/* convert on the stack when the strings are short enough */
+		UChar local_buf1[UCHAR_LOCAL_BUFSIZE];
+		UChar local_buf2[UCHAR_LOCAL_BUFSIZE];
 		UChar *uchar1, *uchar2;
+		int32_t ulen1, ulen2;
 
-		ulen1 = string_to_uchar(&uchar1, text_to_cstring(txt1), len1);
-		ulen2 = string_to_uchar(&uchar2, text_to_cstring(txt2), len2);
+		ulen1 = string_to_uchar_scratch(&uchar1, local_buf1, 0, str1, len1);
+		ulen2 = string_to_uchar_scratch(&uchar2, local_buf2, 1, str2, len2);
 
 		result = ucol_strcoll(collator,
 							  uchar1, ulen1,
 							  uchar2, ulen2);
-
-		pfree(uchar1);
-		pfree(uchar2);
 	}
 	return result;
 }
@@ -828,33 +1463,25 @@ icu_compare_coll(PG_FUNCTION_ARGS)
 	text *txt1 = PG_GETARG_TEXT_PP(0);
 	text *txt2 = PG_GETARG_TEXT_PP(1);
 	const char *collname = text_to_cstring(PG_GETARG_TEXT_P(2));
-	UCollator	*collator = NULL;
-	UErrorCode	status = U_ZERO_ERROR;
+	UCollator	*collator = ucollator_from_locale(collname);
 	UCollationResult result;
 
-	collator = ucol_open(collname, &status);
-	if (!collator || U_FAILURE(status)) {
-		elog(ERROR, "failed to open collation: %s", u_errorName(status));
-	}
-
 	result = our_strcoll(txt1, txt2, collator);
-	ucol_close(collator);
 
 	PG_RETURN_INT32(result == UCOL_EQUAL ? 0 :
 					(result == UCOL_GREATER ? 1 : -1));
 }
 
 /*
- * Compare two strings with the collation of the function,
- * which must be an ICU collation.
+ * Compare two strings with a collation built from tailoring rules.
  * Return the result as a signed integer, similarly to strcoll().
  */
 Datum
-icu_compare(PG_FUNCTION_ARGS)
+icu_compare_rules(PG_FUNCTION_ARGS)
 {
 	text *txt1 = PG_GETARG_TEXT_PP(0);
 	text *txt2 = PG_GETARG_TEXT_PP(1);
-	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+	UCollator	*collator = ucollator_from_rules(PG_GETARG_TEXT_PP(2));
 	UCollationResult result;
 
 	result = our_strcoll(txt1, txt2, collator);
@@ -863,45 +1490,478 @@ icu_compare(PG_FUNCTION_ARGS)
 					(result == UCOL_GREATER ? 1 : -1));
 }
 
-
 /*
- * Compare two strings with full case folding.
+ * Compare two strings with the collation of the function,
+ * which must be an ICU collation.
+ * Return the result as a signed integer, similarly to strcoll().
  */
 Datum
-icu_case_compare(PG_FUNCTION_ARGS)
+icu_compare(PG_FUNCTION_ARGS)
 {
 	text *txt1 = PG_GETARG_TEXT_PP(0);
-	int32_t len1 = VARSIZE_ANY_EXHDR(txt1);
+	text *txt2 = PG_GETARG_TEXT_PP(1);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+	UCollationResult result;
+
+	result = our_strcoll(txt1, txt2, collator);
+
+	PG_RETURN_INT32(result == UCOL_EQUAL ? 0 :
+					(result == UCOL_GREATER ? 1 : -1));
+}
+
+
+/*
+ * Comparison operators of the icu_text_ops operator class, collating
+ * with the ICU collation of the arguments like icu_compare(text,text).
+ */
+static UCollationResult
+icu_text_cmp_internal(PG_FUNCTION_ARGS)
+{
+	text *txt1 = PG_GETARG_TEXT_PP(0);
+	text *txt2 = PG_GETARG_TEXT_PP(1);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	return our_strcoll(txt1, txt2, collator);
+}
+
+Datum
+icu_text_lt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) == UCOL_LESS);
+}
+
+Datum
+icu_text_le(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) != UCOL_GREATER);
+}
+
+Datum
+icu_text_eq(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) == UCOL_EQUAL);
+}
+
+Datum
+icu_text_ne(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) != UCOL_EQUAL);
+}
+
+Datum
+icu_text_ge(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) != UCOL_LESS);
+}
+
+Datum
+icu_text_gt(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(icu_text_cmp_internal(fcinfo) == UCOL_GREATER);
+}
+
+/*
+ * Set up @iter to iterate over the contents of @txt, for the ICU
+ * functions that produce sort keys by pieces.
+ * In UTF-8 databases, the iterator works directly on the text.
+ * Otherwise the text is converted into *ustring, to be freed by the
+ * caller if non-NULL.
+ */
+static void
+text_iterator_init(UCharIterator *iter, text *txt, UChar **ustring)
+{
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		uiter_setUTF8(iter, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
+		*ustring = NULL;
+	}
+	else
+	{
+		int32_t ulen = string_to_uchar(ustring,
+									   VARDATA_ANY(txt),
+									   VARSIZE_ANY_EXHDR(txt));
+		uiter_setString(iter, *ustring, ulen);
+	}
+}
+
+/*
+ * Fill @dest with the first @count bytes of the sort key of @txt,
+ * without computing the rest of the key.
+ * Return the number of bytes produced, which is less than @count
+ * only when the whole key fits. Contrary to ucol_getSortKey(), the
+ * key produced by pieces is not terminated by a NUL byte.
+ */
+static int32_t
+sort_key_prefix(UCollator *collator, text *txt, uint8_t *dest, int32_t count)
+{
+	UCharIterator iter;
+	uint32_t state[2] = {0, 0};
+	UErrorCode status = U_ZERO_ERROR;
+	UChar *ustring;
+	int32_t len;
+
+	text_iterator_init(&iter, txt, &ustring);
+
+	len = ucol_nextSortKeyPart(collator, &iter, state, dest, count, &status);
+	if (U_FAILURE(status))
+		elog(ERROR, "ucol_nextSortKeyPart() failed: %s", u_errorName(status));
+
+	if (ustring != NULL)
+		pfree(ustring);
+
+	return len;
+}
+
+/*
+ * Return the sort key of @txt as a bytea, truncated to its first
+ * @max_bytes bytes. The key is produced by pieces into a buffer
+ * that grows as needed, and the bytes past @max_bytes are never
+ * computed.
+ */
+static bytea *
+sort_key_bytea(UCollator *collator, text *txt, int32_t max_bytes)
+{
+	UCharIterator iter;
+	uint32_t state[2] = {0, 0};
+	UErrorCode status = U_ZERO_ERROR;
+	UChar *ustring;
+	int32_t capacity;
+	int32_t len = 0;
+	bytea *output;
+
+	if (max_bytes < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("the maximum length of a sort key cannot be negative")));
+
+	text_iterator_init(&iter, txt, &ustring);
+
+	/* first attempt, enough for most keys of short strings */
+	capacity = Min(max_bytes, Max(256, 3 * VARSIZE_ANY_EXHDR(txt)));
+
+	output = (bytea*) palloc(capacity + VARHDRSZ);
+
+	while (len < max_bytes)
+	{
+		int32_t requested, produced;
+
+		if (len == capacity)
+		{
+			capacity = Min(capacity * 2, max_bytes);
+			output = (bytea*) repalloc(output, capacity + VARHDRSZ);
+		}
+		requested = capacity - len;
+		produced = ucol_nextSortKeyPart(collator,
+										&iter,
+										state,
+										(uint8_t*)VARDATA(output) + len,
+										requested,
+										&status);
+		if (U_FAILURE(status))
+			elog(ERROR, "ucol_nextSortKeyPart() failed: %s", u_errorName(status));
+		len += produced;
+		if (produced < requested)
+			break;				/* the whole key has been produced */
+	}
+
+	if (ustring != NULL)
+		pfree(ustring);
+
+	SET_VARSIZE(output, len + VARHDRSZ);
+	return output;
+}
+
+/*
+ * State of a sort with icu_text_ops.
+ * The abbreviated keys are the first bytes of the ICU sort keys,
+ * so that comparing them with memcmp() gives the same order as
+ * the full comparison, except for ties that must be resolved by
+ * our_strcoll().
+ */
+typedef struct
+{
+	UCollator  *collator;
+	/* to decide whether abbreviation is worth it, like core's varlena.c */
+	hyperLogLogState abbr_card;
+	hyperLogLogState full_card;
+	double		prop_card;
+} icu_sortsupport_state;
+
+static int
+icu_sortsupport_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	icu_sortsupport_state *sss = (icu_sortsupport_state *) ssup->ssup_extra;
+	text *txt1 = DatumGetTextPP(x);
+	text *txt2 = DatumGetTextPP(y);
+	UCollationResult result;
+
+	result = our_strcoll(txt1, txt2, sss->collator);
+
+	/* free the copies if the values were detoasted */
+	if ((Pointer) txt1 != DatumGetPointer(x))
+		pfree(txt1);
+	if ((Pointer) txt2 != DatumGetPointer(y))
+		pfree(txt2);
+
+	return result == UCOL_EQUAL ? 0 : (result == UCOL_GREATER ? 1 : -1);
+}
+
+static int
+icu_sortsupport_abbrev_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	/* abbreviated keys are compared as unsigned integers */
+	if (x > y)
+		return 1;
+	else if (x == y)
+		return 0;
+	else
+		return -1;
+}
+
+static Datum
+icu_sortsupport_abbrev_convert(Datum original, SortSupport ssup)
+{
+	icu_sortsupport_state *sss = (icu_sortsupport_state *) ssup->ssup_extra;
+	text	   *txt = DatumGetTextPP(original);
+	Datum		res = 0;
+	uint32		hash;
+
+	(void) sort_key_prefix(sss->collator, txt, (uint8_t *) &res, sizeof(Datum));
+
+	/*
+	 * The bytes of the key are in memcmp() order, make them compare the
+	 * same way as an integer. Unused trailing bytes are left at zero,
+	 * which sorts shorter keys first like the terminating NUL of a full
+	 * sort key.
+	 */
+	res = DatumBigEndianToNative(res);
+
+	/* feed the cardinality estimators */
+	hash = DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(txt),
+								   Min(VARSIZE_ANY_EXHDR(txt), 1024)));
+	addHyperLogLog(&sss->full_card, hash);
+#if SIZEOF_DATUM == 8
+	hash = DatumGetUInt32(hash_uint32((uint32) (res ^ (res >> 32))));
+#else
+	hash = DatumGetUInt32(hash_uint32((uint32) res));
+#endif
+	addHyperLogLog(&sss->abbr_card, hash);
+
+	if ((Pointer) txt != DatumGetPointer(original))
+		pfree(txt);
+
+	return res;
+}
+
+/*
+ * Abort abbreviation when the abbreviated keys are not distinct enough
+ * to save full comparisons, with the heuristics of varstr_abbrev_abort()
+ * in varlena.c.
+ */
+static bool
+icu_sortsupport_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	icu_sortsupport_state *sss = (icu_sortsupport_state *) ssup->ssup_extra;
+	double		abbrev_distinct,
+				key_distinct;
+
+	/* too few tuples to judge */
+	if (memtupcount < 100)
+		return false;
+
+	abbrev_distinct = Max(estimateHyperLogLog(&sss->abbr_card), 1.0);
+	key_distinct = Max(estimateHyperLogLog(&sss->full_card), 1.0);
+
+	/*
+	 * With that many distinct abbreviated keys, most comparisons are
+	 * resolved by them whatever the size of the sort.
+	 */
+	if (abbrev_distinct > 100000.0)
+		return false;
+
+	/*
+	 * The abbreviated keys are about as distinct as the full keys, so
+	 * full comparisons are mostly needed for equal keys.
+	 */
+	if (abbrev_distinct > key_distinct * sss->prop_card)
+	{
+		/* be more demanding as the number of tuples grows */
+		if (memtupcount > 10000)
+			sss->prop_card *= 0.65;
+		return false;
+	}
+
+	/*
+	 * Too many distinct keys share their abbreviated key, including the
+	 * worst case where all the abbreviated keys are identical.
+	 */
+	return true;
+}
+
+/*
+ * Sort support for icu_text_ops: full comparisons with our_strcoll(),
+ * and abbreviated keys taken from the ICU sort keys.
+ */
+Datum
+icu_text_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+	MemoryContext oldcontext;
+	icu_sortsupport_state *sss;
+
+	oldcontext = MemoryContextSwitchTo(ssup->ssup_cxt);
+
+	sss = palloc(sizeof(icu_sortsupport_state));
+	sss->collator = ucollator_from_coll_id(ssup->ssup_collation);
+	sss->prop_card = 0.20;
+	initHyperLogLog(&sss->abbr_card, 10);
+	initHyperLogLog(&sss->full_card, 10);
+
+	ssup->ssup_extra = sss;
+	ssup->comparator = icu_sortsupport_cmp;
+
+	if (ssup->abbreviate)
+	{
+		ssup->abbrev_full_comparator = ssup->comparator;
+		ssup->comparator = icu_sortsupport_abbrev_cmp;
+		ssup->abbrev_converter = icu_sortsupport_abbrev_convert;
+		ssup->abbrev_abort = icu_sortsupport_abbrev_abort;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Comparison of icu_sortkey values: sort keys compare with memcmp(),
+ * a key that is a prefix of another one being lower.
+ */
+static int
+icu_sortkey_cmp(Datum x, Datum y, SortSupport ssup)
+{
+	bytea *key1 = DatumGetByteaPP(x);
+	bytea *key2 = DatumGetByteaPP(y);
+	int len1 = VARSIZE_ANY_EXHDR(key1);
+	int len2 = VARSIZE_ANY_EXHDR(key2);
+	int result;
+
+	result = memcmp(VARDATA_ANY(key1), VARDATA_ANY(key2), Min(len1, len2));
+	if (result == 0 && len1 != len2)
+		result = (len1 < len2) ? -1 : 1;
+
+	if ((Pointer) key1 != DatumGetPointer(x))
+		pfree(key1);
+	if ((Pointer) key2 != DatumGetPointer(y))
+		pfree(key2);
+
+	return result;
+}
+
+static Datum
+icu_sortkey_abbrev_convert(Datum original, SortSupport ssup)
+{
+	icu_sortsupport_state *sss = (icu_sortsupport_state *) ssup->ssup_extra;
+	bytea	   *key = DatumGetByteaPP(original);
+	int			len = VARSIZE_ANY_EXHDR(key);
+	Datum		res = 0;
+	uint32		hash;
+
+	/* the first bytes of the key, zero-padded like in icu_text_ops */
+	memcpy(&res, VARDATA_ANY(key), Min(len, sizeof(Datum)));
+	res = DatumBigEndianToNative(res);
+
+	hash = DatumGetUInt32(hash_any((unsigned char *) VARDATA_ANY(key),
+								   Min(len, 1024)));
+	addHyperLogLog(&sss->full_card, hash);
+#if SIZEOF_DATUM == 8
+	hash = DatumGetUInt32(hash_uint32((uint32) (res ^ (res >> 32))));
+#else
+	hash = DatumGetUInt32(hash_uint32((uint32) res));
+#endif
+	addHyperLogLog(&sss->abbr_card, hash);
+
+	if ((Pointer) key != DatumGetPointer(original))
+		pfree(key);
+
+	return res;
+}
+
+/*
+ * Sort support for the icu_sortkey type: memcmp() comparisons,
+ * and abbreviated keys made of the first bytes of the sort keys.
+ */
+Datum
+icu_sortkey_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+	MemoryContext oldcontext;
+	icu_sortsupport_state *sss;
+
+	oldcontext = MemoryContextSwitchTo(ssup->ssup_cxt);
+
+	sss = palloc(sizeof(icu_sortsupport_state));
+	sss->collator = NULL;		/* not needed to compare sort keys */
+	sss->prop_card = 0.20;
+	initHyperLogLog(&sss->abbr_card, 10);
+	initHyperLogLog(&sss->full_card, 10);
+
+	ssup->ssup_extra = sss;
+	ssup->comparator = icu_sortkey_cmp;
+
+	if (ssup->abbreviate)
+	{
+		ssup->abbrev_full_comparator = ssup->comparator;
+		ssup->comparator = icu_sortsupport_abbrev_cmp;
+		ssup->abbrev_converter = icu_sortkey_abbrev_convert;
+		ssup->abbrev_abort = icu_sortsupport_abbrev_abort;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Compare two strings with full case folding.
+ */
+Datum
+icu_case_compare(PG_FUNCTION_ARGS)
+{
+	text *txt1 = PG_GETARG_TEXT_PP(0);
+	int32_t len1 = VARSIZE_ANY_EXHDR(txt1);
 	text *txt2 = PG_GETARG_TEXT_PP(1);
 	int32_t len2 = VARSIZE_ANY_EXHDR(txt2);
 	int32_t result;
+	UChar local_buf1[UCHAR_LOCAL_BUFSIZE];
+	UChar local_buf2[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1, *uchar2;
 
-	(void)string_to_uchar(&uchar1, text_to_cstring(txt1), len1);
-	(void)string_to_uchar(&uchar2, text_to_cstring(txt2), len2);
+	(void)string_to_uchar_scratch(&uchar1, local_buf1, 0, VARDATA_ANY(txt1), len1);
+	(void)string_to_uchar_scratch(&uchar2, local_buf2, 1, VARDATA_ANY(txt2), len2);
 
 	result = u_strcasecmp(uchar1, uchar2, 0);
 
-	pfree(uchar1);
-	pfree(uchar2);
-
 	PG_RETURN_INT32(result);
 }
 
 /*
- * Return a binary sort key corresponding to the string and
- * its collation (through a COLLATE clause).
+ * Return the complete sort key of @txt as a bytea, without the
+ * ending NUL byte.
+ * In UTF-8 databases, the key is produced by pieces from the string
+ * as it is, which avoids its conversion to UTF-16. Otherwise, the
+ * converted string is passed to ucol_getSortKey().
  */
-Datum
-icu_sort_key(PG_FUNCTION_ARGS)
+static bytea *
+sort_key_full(UCollator *collator, text *txt)
 {
-	text *txt = PG_GETARG_TEXT_PP(0);
-	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
 	int32_t o_len = 1024;		/* first attempt */
 	int32_t ulen;
 	UChar *ustring;
 	bytea *output;
 
+	if (GetDatabaseEncoding() == PG_UTF8)
+		return sort_key_bytea(collator, txt, MaxAllocSize - VARHDRSZ);
 
 	ulen = string_to_uchar(&ustring, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
 
@@ -926,8 +1986,23 @@ icu_sort_key(PG_FUNCTION_ARGS)
 		o_len = effective_len;
 	} while (output == NULL);	/* should loop at most once, if buffer too small */
 
+	pfree(ustring);
+
 	SET_VARSIZE(output, o_len + VARHDRSZ - 1);  /* -1 excludes the ending NUL byte */
-	PG_RETURN_BYTEA_P(output);
+	return output;
+}
+
+/*
+ * Return a binary sort key corresponding to the string and
+ * its collation (through a COLLATE clause).
+ */
+Datum
+icu_sort_key(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	PG_RETURN_BYTEA_P(sort_key_full(collator, txt));
 }
 
 /*
@@ -939,45 +2014,313 @@ icu_sort_key_coll(PG_FUNCTION_ARGS)
 {
 	text *txt = PG_GETARG_TEXT_PP(0);
 	const char *locname = text_to_cstring(PG_GETARG_TEXT_P(1));
-	UCollator	*collator;
-	UErrorCode	status = U_ZERO_ERROR;
-	int32_t o_len = 1024;		/* first attempt */
-	int32_t ulen;
-	UChar *ustring;
-	bytea *output;
+	UCollator	*collator = ucollator_from_locale(locname);
 
-	ulen = string_to_uchar(&ustring, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
+	PG_RETURN_BYTEA_P(sort_key_full(collator, txt));
+}
 
-	collator = ucol_open(locname, &status);
-	if (!collator)
-		elog(ERROR, "failed to open collation");
+/*
+ * Return a binary sort key corresponding to the string and
+ * a collation built from tailoring rules.
+ */
+Datum
+icu_sort_key_rules(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	UCollator	*collator = ucollator_from_rules(PG_GETARG_TEXT_PP(1));
 
-	do
+	PG_RETURN_BYTEA_P(sort_key_full(collator, txt));
+}
+
+/*
+ * Return the first bytes of the binary sort key corresponding to
+ * the string and its collation (through a COLLATE clause).
+ * arg1=string, arg2=maximum number of bytes
+ */
+Datum
+icu_sort_key_prefix(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	int32 max_bytes = PG_GETARG_INT32(1);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	PG_RETURN_BYTEA_P(sort_key_bytea(collator, txt, max_bytes));
+}
+
+/*
+ * Return the first bytes of the binary sort key corresponding to
+ * the string and the given collation.
+ * arg1=string, arg2=collator, arg3=maximum number of bytes
+ */
+Datum
+icu_sort_key_prefix_coll(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	const char *locname = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	int32 max_bytes = PG_GETARG_INT32(2);
+	UCollator *collator = ucollator_from_locale(locname);
+
+	PG_RETURN_BYTEA_P(sort_key_bytea(collator, txt, max_bytes));
+}
+
+/*
+ * Compute the sort keys of all the elements of a text array.
+ * The keys are accumulated in a single buffer before being copied
+ * into the result, a bytea[] with the same dimensions as the input,
+ * and NULL for NULL input elements.
+ * In UTF-8 databases, the keys are produced by pieces from
+ * the strings as they are. Otherwise, the strings are converted
+ * to UTF-16 in a scratch buffer reused for all elements.
+ */
+static ArrayType *
+sort_keys_array(UCollator *collator, ArrayType *arr)
+{
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nitems;
+	int32	   *key_lens;
+	StringInfoData keys;
+	UChar	   *ubuf = NULL;
+	int32_t		ubuf_size = 0;
+	bool		is_utf8 = (GetDatabaseEncoding() == PG_UTF8);
+	bool		has_nulls = false;
+	Size		nbytes;
+	int32		dataoffset;
+	ArrayType  *result;
+	char	   *key_ptr;
+	char	   *data_ptr;
+	bits8	   *bitmap;
+	int			ndims = ARR_NDIM(arr);
+
+	if (ndims == 0)
+		return construct_empty_array(BYTEAOID);
+
+	deconstruct_array(arr, TEXTOID, -1, false, 'i', &elems, &nulls, &nitems);
+
+	key_lens = (int32 *) palloc(nitems * sizeof(int32));
+	initStringInfo(&keys);
+
+	for (int i = 0; i < nitems; i++)
 	{
-		int32_t effective_len;
-		output = (bytea*) palloc(o_len + VARHDRSZ);
-		effective_len = ucol_getSortKey(collator,
-										ustring,
-										ulen,
-										(uint8_t*)VARDATA(output),
-										o_len);
-		if (effective_len == 0)
+		text	   *txt;
+		int32_t		key_len;
+
+		if (nulls[i])
 		{
-			ucol_close(collator);
-			elog(ERROR, "ucol_getSortKey() failed: internal error");
+			has_nulls = true;
+			key_lens[i] = 0;
+			continue;
 		}
-		if (effective_len > o_len)
+
+		txt = DatumGetTextPP(elems[i]);
+
+		if (is_utf8)
 		{
-			pfree(output);
-			output = NULL;
+			UCharIterator iter;
+			uint32_t	state[2] = {0, 0};
+			int32_t		requested = 256;
+			int32_t		produced;
+
+			uiter_setUTF8(&iter, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
+			key_len = 0;
+			do
+			{
+				UErrorCode	status = U_ZERO_ERROR;
+
+				enlargeStringInfo(&keys, requested);
+				produced = ucol_nextSortKeyPart(collator, &iter, state,
+												(uint8_t *) keys.data + keys.len,
+												requested, &status);
+				if (U_FAILURE(status))
+					elog(ERROR, "ucol_nextSortKeyPart() failed: %s", u_errorName(status));
+				keys.len += produced;
+				key_len += produced;
+			} while (produced == requested);
 		}
-		o_len = effective_len;
-	} while (output == NULL);	/* should loop at most once, if buffer too small */
+		else
+		{
+			int32_t		ulen;
+			int32_t		avail;
 
-	ucol_close(collator);
+			/* a string never has more UTF-16 code units than bytes */
+			if (ubuf_size < VARSIZE_ANY_EXHDR(txt) + 1)
+			{
+				if (ubuf != NULL)
+					pfree(ubuf);
+				ubuf_size = Max(VARSIZE_ANY_EXHDR(txt) + 1, 256);
+				ubuf = (UChar *) palloc(ubuf_size * sizeof(UChar));
+			}
+			ulen = string_to_uchar_buffer(ubuf, ubuf_size,
+										  VARDATA_ANY(txt),
+										  VARSIZE_ANY_EXHDR(txt));
+
+			avail = keys.maxlen - keys.len - 1;
+			key_len = ucol_getSortKey(collator, ubuf, ulen,
+									  (uint8_t *) keys.data + keys.len, avail);
+			if (key_len > avail)
+			{
+				/* buffer too small: enlarge it and retry */
+				enlargeStringInfo(&keys, key_len);
+				key_len = ucol_getSortKey(collator, ubuf, ulen,
+										  (uint8_t *) keys.data + keys.len, key_len);
+			}
+			if (key_len == 0)
+				elog(ERROR, "ucol_getSortKey() failed: internal error");
+			key_len--;			/* exclude the ending NUL byte */
+			keys.len += key_len;
+		}
+		key_lens[i] = key_len;
+	}
 
-	SET_VARSIZE(output, o_len + VARHDRSZ - 1);  /* -1 excludes the ending NUL byte */
-	PG_RETURN_BYTEA_P(output);
+	/* Build the bytea[] result in one allocation */
+	nbytes = 0;
+	for (int i = 0; i < nitems; i++)
+	{
+		if (!nulls[i])
+			nbytes += INTALIGN(VARHDRSZ + key_lens[i]);
+	}
+	if (has_nulls)
+	{
+		dataoffset = ARR_OVERHEAD_WITHNULLS(ndims, nitems);
+		nbytes += dataoffset;
+	}
+	else
+	{
+		dataoffset = 0;
+		nbytes += ARR_OVERHEAD_NONULLS(ndims);
+	}
+
+	result = (ArrayType *) palloc0(nbytes);
+	SET_VARSIZE(result, nbytes);
+	result->ndim = ndims;
+	result->dataoffset = dataoffset;
+	result->elemtype = BYTEAOID;
+	memcpy(ARR_DIMS(result), ARR_DIMS(arr), ndims * sizeof(int));
+	memcpy(ARR_LBOUND(result), ARR_LBOUND(arr), ndims * sizeof(int));
+
+	bitmap = ARR_NULLBITMAP(result);
+	data_ptr = ARR_DATA_PTR(result);
+	key_ptr = keys.data;
+	for (int i = 0; i < nitems; i++)
+	{
+		if (nulls[i])
+			continue;
+		if (bitmap != NULL)
+			bitmap[i / BITS_PER_BYTE] |= (1 << (i % BITS_PER_BYTE));
+		SET_VARSIZE(data_ptr, VARHDRSZ + key_lens[i]);
+		memcpy(VARDATA(data_ptr), key_ptr, key_lens[i]);
+		key_ptr += key_lens[i];
+		data_ptr += INTALIGN(VARHDRSZ + key_lens[i]);
+	}
+
+	pfree(keys.data);
+	pfree(key_lens);
+	if (ubuf != NULL)
+		pfree(ubuf);
+
+	return result;
+}
+
+/*
+ * Return the binary sort keys of the strings of an array, with their
+ * collation (through a COLLATE clause).
+ */
+Datum
+icu_sort_keys(PG_FUNCTION_ARGS)
+{
+	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	PG_RETURN_ARRAYTYPE_P(sort_keys_array(collator, arr));
+}
+
+/*
+ * Return the binary sort keys of the strings of an array, with
+ * the given collation.
+ */
+Datum
+icu_sort_keys_coll(PG_FUNCTION_ARGS)
+{
+	ArrayType *arr = PG_GETARG_ARRAYTYPE_P(0);
+	const char *locname = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	UCollator *collator = ucollator_from_locale(locname);
+
+	PG_RETURN_ARRAYTYPE_P(sort_keys_array(collator, arr));
+}
+
+/*
+ * Hash a string through its binary sort key, so that all the strings
+ * that are equal for the collator get the same hash value.
+ */
+static Datum
+sort_key_hash(UCollator *collator, text *txt, bool extended, uint64 seed)
+{
+	bytea *key = sort_key_full(collator, txt);
+	Datum result;
+
+	if (extended)
+		result = hash_any_extended((unsigned char *) VARDATA(key),
+								   VARSIZE(key) - VARHDRSZ,
+								   seed);
+	else
+		result = hash_any((unsigned char *) VARDATA(key),
+						  VARSIZE(key) - VARHDRSZ);
+	pfree(key);
+	return result;
+}
+
+/*
+ * Return a hash value of the string with its collation
+ * (through a COLLATE clause). This is the hash support function
+ * of the icu_text_hash_ops operator class.
+ */
+Datum
+icu_hash(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	return sort_key_hash(collator, txt, false, 0);
+}
+
+/*
+ * Return a hash value of the string with the given collation.
+ */
+Datum
+icu_hash_coll(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	const char *locname = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	UCollator *collator = ucollator_from_locale(locname);
+
+	return sort_key_hash(collator, txt, false, 0);
+}
+
+/*
+ * 64-bit seeded variant of icu_hash(text).
+ * arg1=string, arg2=seed
+ */
+Datum
+icu_hash_extended(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	UCollator *collator = ucollator_from_coll_id(PG_GET_COLLATION());
+
+	return sort_key_hash(collator, txt, true, PG_GETARG_INT64(1));
+}
+
+/*
+ * 64-bit seeded variant of icu_hash(text, text).
+ * arg1=string, arg2=locale, arg3=seed
+ */
+Datum
+icu_hash_extended_coll(PG_FUNCTION_ARGS)
+{
+	text *txt = PG_GETARG_TEXT_PP(0);
+	const char *locname = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	UCollator *collator = ucollator_from_locale(locname);
+
+	return sort_key_hash(collator, txt, true, PG_GETARG_INT64(2));
 }
 
 /* Return the first UChar32 of the char(1) string */
@@ -1238,5 +2581,42 @@ _PG_init(void)
 							   assign_guc_timestamptz_format,
 							   NULL);
 
+	DefineCustomIntVariable("icu_ext.collator_cache_size",
+							"Sets the maximum number of ICU collators kept open by each session.",
+							NULL,
+							&icu_ext_collator_cache_size,
+							8,
+							1,
+							1000,
+							PGC_USERSET,
+							0,
+							NULL,
+							assign_guc_collator_cache_size,
+							NULL);
+
+	DefineCustomBoolVariable("icu_ext.track_functions",
+							 "Collects statistics on the calls to the functions of icu_ext.",
+							 NULL,
+							 &icu_ext_track_functions,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomStringVariable("icu_ext.tsearch_locale",
+							   "Sets the locale of the word break iterator of the icu_ext text search parsers.",
+							   "It is meant to be set by the SET clause of the start function of a parser.",
+							   &icu_ext_tsearch_locale,
+							   "",
+							   PGC_USERSET,
+							   0,
+							   NULL,
+							   NULL,
+							   NULL);
+
 	EmitWarningsOnPlaceholders("icu_ext");
+
+	icu_ext_stats_init();
 }
@@ -11,6 +11,7 @@
 #include "fmgr.h"
 #include "datatype/timestamp.h"
 
+#include "unicode/ubrk.h"
 #include "unicode/ucol.h"
 #include "unicode/udat.h"
 
@@ -28,10 +29,17 @@ typedef struct {
 } icu_interval_t;
 
 UCollator* ucollator_from_coll_id(Oid collid);
+UCollator* ucollator_from_locale(const char *locname);
+UCollator* ucollator_from_rules(text *rules);
+
+UBreakIterator* open_break_iterator(UBreakIteratorType break_type, const char *locale);
 
 extern char *icu_ext_default_locale;
 extern char *icu_ext_date_format;
 extern char *icu_ext_timestamptz_format;
+extern int icu_ext_collator_cache_size;
+extern bool icu_ext_track_functions;
+extern char *icu_ext_tsearch_locale;
 extern UDateFormatStyle icu_ext_date_style;
 extern UDateFormatStyle icu_ext_timestamptz_style;
 
@@ -60,5 +68,51 @@ extern Datum icu_timestamptz_sub_interval(PG_FUNCTION_ARGS);
 #define UDATE_TO_TS(ud) \
   (TimestampTz)((ud)*1000 - 10957LL*86400*1000*1000)
 
+bool is_ascii_string(const char *s, size_t len);
 int32_t string_to_uchar(UChar **buff_uchar, const char *buff, size_t nbytes);
+int32_t string_to_uchar_buffer(UChar *buf, int32_t buf_size, const char *buff, size_t nbytes);
 int32_t string_from_uchar(char **result, const UChar *buff_uchar, int32_t len_uchar);
+int32_t string_from_uchar_length(const UChar *buff_uchar, int32_t len_uchar);
+
+/* scratch buffers for UTF-16 strings, see icu_ext.c */
+#define UCHAR_LOCAL_BUFSIZE		256
+#define UCHAR_SCRATCH_SLOTS		3
+
+UChar *uchar_scratch_buffer(int slot, int32_t size);
+int32_t string_to_uchar_scratch(UChar **dest, UChar *local_buf, int slot,
+								const char *buff, size_t nbytes);
+
+/*
+ * Counters reported by icu_ext_stats() for each entry point, when
+ * icu_ext.track_functions is enabled (see icu_stats.c), in the
+ * order of the columns of icu_ext_stats().
+ */
+typedef enum icu_ext_stat
+{
+	ICU_STAT_BYTES_TO_UCHAR,
+	ICU_STAT_BYTES_FROM_UCHAR,
+	ICU_STAT_UCOL_OPEN,
+	ICU_STAT_UDAT_OPEN,
+	ICU_STAT_UCAL_OPEN,
+	ICU_STAT_UBRK_OPEN,
+	ICU_STAT_USEARCH_OPEN,
+	ICU_STAT_USPOOF_OPEN,
+	ICU_STAT_UTRANS_OPEN,
+	ICU_STAT_UNUM_OPEN,
+	ICU_STAT_COLLATOR_CACHE_HIT,
+	ICU_STAT_COLLATOR_CACHE_MISS,
+	ICU_STAT_TRANSLITERATOR_CACHE_HIT,
+	ICU_STAT_TRANSLITERATOR_CACHE_MISS,
+	ICU_STAT_BREAK_ITERATOR_CACHE_HIT,
+	ICU_STAT_BREAK_ITERATOR_CACHE_MISS,
+	ICU_STAT_COUNT				/* must be last */
+} icu_ext_stat;
+
+void icu_ext_stats_init(void);
+void icu_ext_stats_add(icu_ext_stat stat, uint64 n);
+
+#define ICU_EXT_COUNT(stat, n) \
+	do { \
+		if (icu_ext_track_functions) \
+			icu_ext_stats_add(stat, n); \
+	} while (0)
@@ -65,6 +65,7 @@ add_interval(TimestampTz ts, const icu_interval_t *ival, const char *locale)
 	{
 		elog(ERROR, "ucal_open failed: %s\n", u_errorName(status));
 	}
+	ICU_EXT_COUNT(ICU_STAT_UCAL_OPEN, 1);
 
 	ucal_setMillis(ucal, date_time, &status);
 
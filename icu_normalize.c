@@ -11,7 +11,15 @@
 
 /* Postgres includes */
 
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
+#include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
 #include "mb/pg_wchar.h"
+#include "miscadmin.h"
 #include "utils/builtins.h"
 #include "utils/pg_locale.h"
 #if PG_VERSION_NUM >= 160000
@@ -20,10 +28,16 @@
 
 /* ICU includes */
 #include "unicode/unorm.h"
+#include "unicode/utf8.h"
 
 
 PG_FUNCTION_INFO_V1(icu_is_normalized);
 PG_FUNCTION_INFO_V1(icu_normalize);
+PG_FUNCTION_INFO_V1(icu_nfc_text_in);
+PG_FUNCTION_INFO_V1(icu_nfc_text_recv);
+PG_FUNCTION_INFO_V1(icu_nfc_text_from_text);
+PG_FUNCTION_INFO_V1(icu_nfc_text_normalize);
+PG_FUNCTION_INFO_V1(icu_nfc_text_is_normalized);
 
 typedef enum {
 	UNICODE_NFC,
@@ -74,61 +88,266 @@ UNormalizer2* norm_instance(norm_form_t form)
 }
 
 /*
- * Return the string (1st arg) with the given Unicode normalization
- * (2nd arg).
+ * Check directly on UTF-8 that all the code points of a string are
+ * below the first one that can be affected by the normalization form,
+ * U+0300 for NFC, U+00C0 for NFD, and U+00A0 for NFKC and NFKD.
+ * Such strings are in the normal form, and the check amounts to
+ * comparing each byte to the lead byte of that first code point.
+ * Latin-1 text is covered for NFC, besides ASCII for all forms.
  */
-Datum
-icu_normalize(PG_FUNCTION_ARGS)
+static bool
+is_quick_check_yes_utf8(norm_form_t form, const char *s, size_t len)
 {
-	text *src_text = PG_GETARG_TEXT_PP(0);
-	const char* arg_form = text_to_cstring(PG_GETARG_TEXT_P(1));
-	norm_form_t form = name_to_norm(arg_form);
-	const UNormalizer2 *instance = norm_instance(form);
-	int32_t u_src_length, u_dest_length, effective_length, result_len;
-	char *result;
-	UChar *u_src, *u_dest;
-	UErrorCode	status = U_ZERO_ERROR;
-
-	if (GetDatabaseEncoding() != PG_UTF8)
-		elog(ERROR, "non-Unicode database encoding");
+	const unsigned char *p = (const unsigned char *) s;
+	const unsigned char *end = p + len;
+	unsigned char limit;
 
-	u_src_length = string_to_uchar(&u_src,
-								VARDATA_ANY(src_text),
-								VARSIZE_ANY_EXHDR(src_text));
+	if (is_ascii_string(s, len))
+		return true;
 
-	/*
-	 * The result may be expanded by the maximum factor given at:
-	 * https://unicode.org/faq/normalization.html#12
-	 * (given that the UChar buffer is in UTF-16)
-	 */
-	switch(form)
+	switch (form)
 	{
 	case UNICODE_NFC:
-		u_dest_length = u_src_length * 3;
+		limit = 0xCC;			/* U+0300 is CC 80 */
 		break;
 	case UNICODE_NFD:
-		u_dest_length = u_src_length * 4;
+		limit = 0xC3;			/* U+00C0 is C3 80 */
 		break;
-	case UNICODE_NFKC:
-	case UNICODE_NFKD:
 	default:
-		u_dest_length = u_src_length * 18;
-		break;
+		return false;			/* U+00A0 is C2 A0 */
 	}
 
-	u_dest = (UChar*) palloc(u_dest_length*sizeof(UChar));
+	while (p < end && *p < limit)
+		p++;
+	return (p == end);
+}
+
+/*
+ * Values stored out of line and uncompressed above this size are
+ * normalized by slices of NORMALIZE_SLICE_SIZE bytes, instead of being
+ * detoasted and converted to UTF-16 as a whole.
+ */
+#define NORMALIZE_STREAM_MIN_SIZE	(1024 * 1024)
+#define NORMALIZE_SLICE_SIZE		(256 * 1024)
+
+/*
+ * Normalize the UTF-8 string @src of @src_len bytes, appending the
+ * result to @out.
+ * Strings already in the normal form are the common case, so they are
+ * detected first with a quick check, and false is returned without
+ * appending anything. Otherwise only the part after the longest
+ * normalized prefix is normalized and appended to that prefix.
+ * That part goes through UTF-16: ICU normalizes UTF-8 in place only
+ * with the C++ Normalizer2::normalizeUTF8(), and icu_ext is kept as
+ * plain C rather than adding a C++ translation unit for it.
+ */
+static bool
+normalize_append(norm_form_t form,
+				 const char *src, int32_t src_len,
+				 StringInfo out)
+{
+	const UNormalizer2 *instance;
+	UChar local_buf[UCHAR_LOCAL_BUFSIZE];
+	UChar *u_src, *u_dest;
+	int32_t u_src_length, u_dest_capacity, span, effective_length, result_len;
+	char *result;
+	UErrorCode	status = U_ZERO_ERROR;
+
+	if (is_quick_check_yes_utf8(form, src, src_len))
+		return false;
+
+	instance = norm_instance(form);
+	u_src_length = string_to_uchar_scratch(&u_src, local_buf, 0, src, src_len);
 
-	effective_length = unorm2_normalize(instance,
-										u_src,
-										u_src_length,
-										u_dest,
-										u_dest_length,
-										&status);
+	span = unorm2_spanQuickCheckYes(instance, u_src, u_src_length, &status);
 	if (U_FAILURE(status))
-		elog(ERROR, "unorm2_normalize failure: %s", u_errorName(status));
+		elog(ERROR, "unorm2_spanQuickCheckYes failure: %s", u_errorName(status));
+
+	if (span == u_src_length)
+		return false;
+
+	/*
+	 * Start with some room for expansion of the unnormalized part,
+	 * and retry with the exact size if it's not enough. The maximum
+	 * expansion factors given at
+	 * https://unicode.org/faq/normalization.html#12
+	 * are rarely approached in practice.
+	 */
+	u_dest_capacity = u_src_length + (u_src_length - span) / 2 + 16;
+	for (;;)
+	{
+		u_dest = uchar_scratch_buffer(1, u_dest_capacity);
+		memcpy(u_dest, u_src, span * sizeof(UChar));
+
+		status = U_ZERO_ERROR;
+		effective_length = unorm2_normalizeSecondAndAppend(instance,
+														   u_dest,
+														   span,
+														   u_dest_capacity,
+														   u_src + span,
+														   u_src_length - span,
+														   &status);
+		if (status != U_BUFFER_OVERFLOW_ERROR)
+			break;
+		u_dest_capacity = effective_length;
+	}
+	if (U_FAILURE(status))
+		elog(ERROR, "unorm2_normalizeSecondAndAppend failure: %s", u_errorName(status));
 
 	result_len = string_from_uchar(&result, u_dest, effective_length);
-	PG_RETURN_TEXT_P(cstring_to_text_with_len(result, result_len));
+	appendBinaryStringInfo(out, result, result_len);
+	pfree(result);
+	return true;
+}
+
+/*
+ * Return the offset of the last normalization boundary in the UTF-8
+ * string @s of @len bytes, or 0 if there is none. The string may end
+ * with an incomplete character, which is never included before the
+ * boundary.
+ * Normalizing the parts before and after such a boundary separately
+ * gives the same result as normalizing the whole string.
+ */
+static int32_t
+last_norm_boundary(const UNormalizer2 *instance, const char *s, int32_t len)
+{
+	int32_t i = len;
+
+	/* skip the last character, possibly cut in the middle */
+	while (i > 0 && ((unsigned char) s[i - 1] & 0xC0) == 0x80)
+		i--;
+	if (i > 0)
+		i--;
+
+	while (i > 0)
+	{
+		UChar32 c;
+
+		U8_PREV(s, 0, i, c);
+		if (i > 0 && c >= 0 && unorm2_hasBoundaryBefore(instance, c))
+			return i;
+	}
+	return 0;
+}
+
+/*
+ * Should the datum be normalized by slices?
+ */
+static bool
+normalize_by_slices(Datum d)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(d);
+	struct varatt_external toast_pointer;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr))
+		return false;
+
+	/* slices of compressed values are decompressed from the start */
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+	if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+		return false;
+
+	return toast_raw_datum_size(d) - VARHDRSZ > NORMALIZE_STREAM_MIN_SIZE;
+}
+
+/*
+ * Normalize a large value stored out of line, fetching it by slices
+ * that are normalized separately, cut at normalization boundaries.
+ * Only the result and one slice at a time are held in memory,
+ * instead of the whole source in UTF-8 and UTF-16 besides the result.
+ */
+static text *
+normalize_slices(norm_form_t form, Datum d)
+{
+	const UNormalizer2 *instance = norm_instance(form);
+	int32_t total = toast_raw_datum_size(d) - VARHDRSZ;
+	int32_t offset = 0;
+	StringInfoData result;
+	StringInfoData pending;		/* bytes fetched but not normalized yet */
+
+	/* the result is built with room for its varlena header */
+	initStringInfo(&result);
+	enlargeStringInfo(&result, VARHDRSZ + total);
+	result.len = VARHDRSZ;
+
+	initStringInfo(&pending);
+
+	while (offset < total)
+	{
+		int32_t slice_len = Min(NORMALIZE_SLICE_SIZE, total - offset);
+		text *slice = DatumGetTextPSlice(d, offset, slice_len);
+		int32_t cut;
+
+		CHECK_FOR_INTERRUPTS();
+
+		appendBinaryStringInfo(&pending, VARDATA_ANY(slice), VARSIZE_ANY_EXHDR(slice));
+		offset += slice_len;
+		pfree(slice);
+
+		if (offset >= total)
+			cut = pending.len;
+		else
+			cut = last_norm_boundary(instance, pending.data, pending.len);
+
+		if (cut > 0)
+		{
+			if (!normalize_append(form, pending.data, cut, &result))
+				appendBinaryStringInfo(&result, pending.data, cut);
+			memmove(pending.data, pending.data + cut, pending.len - cut);
+			pending.len -= cut;
+		}
+	}
+
+	pfree(pending.data);
+	SET_VARSIZE(result.data, result.len);
+	return (text *) result.data;
+}
+
+/*
+ * Return @src_text normalized, or @src_text itself if it's already
+ * in the normal form.
+ */
+static text *
+normalize_text(norm_form_t form, text *src_text)
+{
+	StringInfoData result;
+
+	if (GetDatabaseEncoding() != PG_UTF8)
+		elog(ERROR, "non-Unicode database encoding");
+
+	initStringInfo(&result);
+	appendStringInfoSpaces(&result, VARHDRSZ);
+
+	if (!normalize_append(form,
+						  VARDATA_ANY(src_text),
+						  VARSIZE_ANY_EXHDR(src_text),
+						  &result))
+	{
+		pfree(result.data);
+		return src_text;
+	}
+
+	SET_VARSIZE(result.data, result.len);
+	return (text *) result.data;
+}
+
+/*
+ * Return the string (1st arg) with the given Unicode normalization
+ * (2nd arg).
+ */
+Datum
+icu_normalize(PG_FUNCTION_ARGS)
+{
+	const char* arg_form = text_to_cstring(PG_GETARG_TEXT_P(1));
+	norm_form_t form = name_to_norm(arg_form);
+
+	if (GetDatabaseEncoding() != PG_UTF8)
+		elog(ERROR, "non-Unicode database encoding");
+
+	if (normalize_by_slices(PG_GETARG_DATUM(0)))
+		PG_RETURN_TEXT_P(normalize_slices(form, PG_GETARG_DATUM(0)));
+
+	PG_RETURN_TEXT_P(normalize_text(form, PG_GETARG_TEXT_PP(0)));
 }
 
 /*
@@ -142,6 +361,7 @@ icu_is_normalized(PG_FUNCTION_ARGS)
 	const char* arg_form = text_to_cstring(PG_GETARG_TEXT_PP(1));
 	norm_form_t form = name_to_norm(arg_form);
 	UErrorCode	status = U_ZERO_ERROR;
+	UChar local_buf[UCHAR_LOCAL_BUFSIZE];
 	UChar *u_src;
 	int32_t u_src_length;
 	UBool is_norm;
@@ -150,9 +370,12 @@ icu_is_normalized(PG_FUNCTION_ARGS)
 	if (GetDatabaseEncoding() != PG_UTF8)
 		elog(ERROR, "non-Unicode database encoding");
 
-	u_src_length = string_to_uchar(&u_src,
-								VARDATA_ANY(src_text),
-								VARSIZE_ANY_EXHDR(src_text));
+	if (is_quick_check_yes_utf8(form, VARDATA_ANY(src_text), VARSIZE_ANY_EXHDR(src_text)))
+		PG_RETURN_BOOL(true);
+
+	u_src_length = string_to_uchar_scratch(&u_src, local_buf, 0,
+										   VARDATA_ANY(src_text),
+										   VARSIZE_ANY_EXHDR(src_text));
 
 	is_norm = unorm2_isNormalized(instance, u_src, u_src_length, &status);
 
@@ -161,3 +384,69 @@ icu_is_normalized(PG_FUNCTION_ARGS)
 
 	PG_RETURN_BOOL(is_norm == 1);
 }
+
+/*
+ * Functions of the icu_nfc_text type, text in Normalization Form C.
+ * Values are normalized when converted from their external
+ * representation or from text, so that the normal form can be
+ * taken for granted afterwards.
+ */
+Datum
+icu_nfc_text_in(PG_FUNCTION_ARGS)
+{
+	char *str = PG_GETARG_CSTRING(0);
+
+	PG_RETURN_TEXT_P(normalize_text(UNICODE_NFC, cstring_to_text(str)));
+}
+
+Datum
+icu_nfc_text_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo buf = (StringInfo) PG_GETARG_POINTER(0);
+	char *str;
+	int nbytes;
+
+	str = pq_getmsgtext(buf, buf->len - buf->cursor, &nbytes);
+	PG_RETURN_TEXT_P(normalize_text(UNICODE_NFC,
+									cstring_to_text_with_len(str, nbytes)));
+}
+
+Datum
+icu_nfc_text_from_text(PG_FUNCTION_ARGS)
+{
+	if (GetDatabaseEncoding() != PG_UTF8)
+		elog(ERROR, "non-Unicode database encoding");
+
+	if (normalize_by_slices(PG_GETARG_DATUM(0)))
+		PG_RETURN_TEXT_P(normalize_slices(UNICODE_NFC, PG_GETARG_DATUM(0)));
+
+	PG_RETURN_TEXT_P(normalize_text(UNICODE_NFC, PG_GETARG_TEXT_PP(0)));
+}
+
+/*
+ * icu_normalize() and icu_is_normalized() for icu_nfc_text values,
+ * which have nothing to do for NFC.
+ */
+Datum
+icu_nfc_text_normalize(PG_FUNCTION_ARGS)
+{
+	const char* arg_form = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	norm_form_t form = name_to_norm(arg_form);
+
+	if (form == UNICODE_NFC)
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+
+	return icu_normalize(fcinfo);
+}
+
+Datum
+icu_nfc_text_is_normalized(PG_FUNCTION_ARGS)
+{
+	const char* arg_form = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	norm_form_t form = name_to_norm(arg_form);
+
+	if (form == UNICODE_NFC)
+		PG_RETURN_BOOL(true);
+
+	return icu_is_normalized(fcinfo);
+}
@@ -45,6 +45,7 @@ icu_number_spellout(PG_FUNCTION_ARGS)
 
 	if (U_FAILURE(status))
 		elog(ERROR, "unum_open failed: %s", u_errorName(status));
+	ICU_EXT_COUNT(ICU_STAT_UNUM_OPEN, 1);
 
 	real_len = unum_formatDouble(nf, number, ubuf, buf_len, NULL, &status);
 	if (status == U_BUFFER_OVERFLOW_ERROR) {		/* buffer too small */
@@ -99,6 +99,8 @@ internal_strpos(text *txt1, text *txt2, UCollator *collator)
 	int32_t len2 = VARSIZE_ANY_EXHDR(txt2);
 	UErrorCode	status = U_ZERO_ERROR;
 	UStringSearch *usearch;
+	UChar local_buf1[UCHAR_LOCAL_BUFSIZE];
+	UChar local_buf2[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1, *uchar2;
 	int32_t ulen1, ulen2;
 	int32_t pos;
@@ -117,8 +119,8 @@ internal_strpos(text *txt1, text *txt2, UCollator *collator)
 	if (len2 == 0)
 	  return 1;
 
-	ulen1 = string_to_uchar(&uchar1, VARDATA_ANY(txt1), len1);
-	ulen2 = string_to_uchar(&uchar2, VARDATA_ANY(txt2), len2);
+	ulen1 = string_to_uchar_scratch(&uchar1, local_buf1, 0, VARDATA_ANY(txt1), len1);
+	ulen2 = string_to_uchar_scratch(&uchar2, local_buf2, 1, VARDATA_ANY(txt2), len2);
 
 	usearch = usearch_openFromCollator(uchar2, /* needle */
 									  ulen2,
@@ -131,6 +133,7 @@ internal_strpos(text *txt1, text *txt2, UCollator *collator)
 		elog(ERROR, "failed to start search: %s", u_errorName(status));
 	else
 	{
+		ICU_EXT_COUNT(ICU_STAT_USEARCH_OPEN, 1);
 		pos = usearch_first(usearch, &status);
 		if (!U_FAILURE(status) && pos != USEARCH_DONE)
 		{
@@ -146,8 +149,6 @@ internal_strpos(text *txt1, text *txt2, UCollator *collator)
 
 	}
 
-	pfree(uchar1);
-	pfree(uchar2);
 	usearch_close(usearch);
 
 	if (U_FAILURE(status))
@@ -177,22 +178,11 @@ Datum
 icu_strpos_coll(PG_FUNCTION_ARGS)
 {
 	const char	*collname = text_to_cstring(PG_GETARG_TEXT_PP(2));
-	UCollator	*collator = NULL;
-	UErrorCode	status = U_ZERO_ERROR;
-	int32_t pos;
-
-	collator = ucol_open(collname, &status);
-	if (!collator || U_FAILURE(status)) {
-		elog(ERROR, "failed to open collation: %s", u_errorName(status));
-	}
+	UCollator	*collator = ucollator_from_locale(collname);
 
-	pos = internal_strpos(PG_GETARG_TEXT_PP(0), /* haystack */
-						  PG_GETARG_TEXT_PP(1), /* needle */
-						  collator);
-
-	ucol_close(collator);
-
-	PG_RETURN_INT32(pos);
+	PG_RETURN_INT32(internal_strpos(PG_GETARG_TEXT_PP(0), /* haystack */
+									PG_GETARG_TEXT_PP(1), /* needle */
+									collator));
 }
 
 
@@ -219,6 +209,8 @@ internal_str_replace(text *txt1, /* not const because it may be returned */
 	int32_t len3 = VARSIZE_ANY_EXHDR(txt3);
 	UErrorCode	status = U_ZERO_ERROR;
 	UStringSearch *usearch;
+	UChar local_buf1[UCHAR_LOCAL_BUFSIZE];
+	UChar local_buf2[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1, *uchar2;
 	int32_t ulen1, ulen2;		/* in utf-16 units */
 	text *result;
@@ -228,8 +220,8 @@ internal_str_replace(text *txt1, /* not const because it may be returned */
 	if (len1 == 0 || len2 == 0)
 		return txt1;
 
-	ulen1 = string_to_uchar(&uchar1, VARDATA_ANY(txt1), len1);
-	ulen2 = string_to_uchar(&uchar2, VARDATA_ANY(txt2), len2);
+	ulen1 = string_to_uchar_scratch(&uchar1, local_buf1, 0, VARDATA_ANY(txt1), len1);
+	ulen2 = string_to_uchar_scratch(&uchar2, local_buf2, 1, VARDATA_ANY(txt2), len2);
 
 	usearch = usearch_openFromCollator(uchar2, /* needle */
 									  ulen2,
@@ -246,6 +238,7 @@ internal_str_replace(text *txt1, /* not const because it may be returned */
 
 	if (U_FAILURE(status))
 		elog(ERROR, "failed to perform ICU search: %s", u_errorName(status));
+	ICU_EXT_COUNT(ICU_STAT_USEARCH_OPEN, 1);
 
 	if (pos != USEARCH_DONE)
 	{
@@ -336,9 +329,6 @@ internal_str_replace(text *txt1, /* not const because it may be returned */
 		result = txt1;
 	}
 
-	pfree(uchar1);
-	pfree(uchar2);
-
 	if (usearch != NULL)
 		usearch_close(usearch);
 
@@ -367,13 +357,7 @@ Datum
 icu_replace_coll(PG_FUNCTION_ARGS)
 {
 	const char	*collname = text_to_cstring(PG_GETARG_TEXT_PP(3));
-	UCollator	*collator = NULL;
-	UErrorCode	status = U_ZERO_ERROR;
-
-	collator = ucol_open(collname, &status);
-	if (!collator || U_FAILURE(status)) {
-		elog(ERROR, "failed to open collation: %s", u_errorName(status));
-	}
+	UCollator	*collator = ucollator_from_locale(collname);
 
 	PG_RETURN_TEXT_P(
 		internal_str_replace(
@@ -10,6 +10,7 @@
 #include "icu_ext.h"
 
 #include "funcapi.h"
+#include "mb/pg_wchar.h"
 #include "utils/builtins.h"
 #include "utils/pg_locale.h"
 
@@ -31,25 +32,53 @@ icu_confusable_string_skeleton(PG_FUNCTION_ARGS)
 	UErrorCode status = U_ZERO_ERROR;
 	USpoofChecker *sc;
 	int32_t ulen1, ulen_skel, result_len;
+	UChar local_buf[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1, *uchar_skel;
 	char *result;
 
 	sc = uspoof_open(&status);
 	if (!sc)
 		elog(ERROR, "ICU uspoof_open failed");
-	ulen1 = string_to_uchar(&uchar1, text_to_cstring(txt1), len1);
+	ICU_EXT_COUNT(ICU_STAT_USPOOF_OPEN, 1);
+
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		/* produce the skeleton directly into the result */
+		int32_t capacity = len1 + 16;
+		text *skel = (text *) palloc(VARHDRSZ + capacity);
+		int32_t skel_len;
+
+		skel_len = uspoof_getSkeletonUTF8(sc, 0, VARDATA_ANY(txt1), len1,
+										  VARDATA(skel), capacity, &status);
+		if (status == U_BUFFER_OVERFLOW_ERROR)
+		{
+			status = U_ZERO_ERROR;
+			capacity = skel_len;
+			skel = (text *) repalloc(skel, VARHDRSZ + capacity);
+			skel_len = uspoof_getSkeletonUTF8(sc, 0, VARDATA_ANY(txt1), len1,
+											  VARDATA(skel), capacity, &status);
+		}
+		uspoof_close(sc);
+
+		if (U_FAILURE(status))
+			elog(ERROR, "ICU uspoof_getSkeletonUTF8 failed: %s", u_errorName(status));
+
+		SET_VARSIZE(skel, VARHDRSZ + skel_len);
+		PG_RETURN_TEXT_P(skel);
+	}
+
+	ulen1 = string_to_uchar_scratch(&uchar1, local_buf, 0, VARDATA_ANY(txt1), len1);
 
 	// maximum of equal length sounds like a sane guess for the first try
-	ulen_skel = ulen1;
-	uchar_skel = (UChar*) palloc((ulen_skel)*sizeof(UChar));
+	ulen_skel = Max(ulen1, UCHAR_LOCAL_BUFSIZE);
+	uchar_skel = uchar_scratch_buffer(1, ulen_skel);
 	ulen_skel = uspoof_getSkeleton(sc, 0, uchar1, ulen1, uchar_skel, ulen_skel, &status);
 
 	if (U_FAILURE(status) && status == U_BUFFER_OVERFLOW_ERROR) {
 		// try again with a properly sized buffer
 		status = U_ZERO_ERROR;
 
-		pfree(uchar_skel);
-		uchar_skel = (UChar*) palloc((ulen_skel)*sizeof(UChar));
+		uchar_skel = uchar_scratch_buffer(1, ulen_skel);
 		ulen_skel = uspoof_getSkeleton(sc, 0, uchar1, ulen1, uchar_skel, ulen_skel, &status);
 	}
 
@@ -75,13 +104,20 @@ icu_spoof_check(PG_FUNCTION_ARGS)
 	USpoofChecker *sc;
 	int32_t bitmask;
 	int32_t ulen1;
+	UChar local_buf[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1;
 
 	sc = uspoof_open(&status);
 	if (!sc)
 		elog(ERROR, "ICU uspoof_open failed");
-	ulen1 = string_to_uchar(&uchar1, text_to_cstring(txt1), len1);
-	bitmask = uspoof_check(sc, uchar1, ulen1, NULL, &status);
+	ICU_EXT_COUNT(ICU_STAT_USPOOF_OPEN, 1);
+	if (GetDatabaseEncoding() == PG_UTF8)
+		bitmask = uspoof_checkUTF8(sc, VARDATA_ANY(txt1), len1, NULL, &status);
+	else
+	{
+		ulen1 = string_to_uchar_scratch(&uchar1, local_buf, 0, VARDATA_ANY(txt1), len1);
+		bitmask = uspoof_check(sc, uchar1, ulen1, NULL, &status);
+	}
 	uspoof_close(sc);
 
 	if (U_FAILURE(status))
@@ -102,6 +138,8 @@ icu_confusable_strings_check(PG_FUNCTION_ARGS)
 	text *txt2 = PG_GETARG_TEXT_PP(1);
 	int32_t len2 = VARSIZE_ANY_EXHDR(txt2);
 	int32_t ulen1, ulen2;
+	UChar local_buf1[UCHAR_LOCAL_BUFSIZE];
+	UChar local_buf2[UCHAR_LOCAL_BUFSIZE];
 	UChar *uchar1, *uchar2;
 	USpoofChecker *sc;
 	UErrorCode	status = U_ZERO_ERROR;
@@ -110,9 +148,18 @@ icu_confusable_strings_check(PG_FUNCTION_ARGS)
 	sc = uspoof_open(&status);
 	if (!sc)
 		elog(ERROR, "ICU uspoof_open failed");
-	ulen1 = string_to_uchar(&uchar1, text_to_cstring(txt1), len1);
-	ulen2 = string_to_uchar(&uchar2, text_to_cstring(txt2), len2);
-	bitmask = uspoof_areConfusable(sc, uchar1, ulen1, uchar2, ulen2, &status);
+	ICU_EXT_COUNT(ICU_STAT_USPOOF_OPEN, 1);
+	if (GetDatabaseEncoding() == PG_UTF8)
+		bitmask = uspoof_areConfusableUTF8(sc,
+										   VARDATA_ANY(txt1), len1,
+										   VARDATA_ANY(txt2), len2,
+										   &status);
+	else
+	{
+		ulen1 = string_to_uchar_scratch(&uchar1, local_buf1, 0, VARDATA_ANY(txt1), len1);
+		ulen2 = string_to_uchar_scratch(&uchar2, local_buf2, 1, VARDATA_ANY(txt2), len2);
+		bitmask = uspoof_areConfusable(sc, uchar1, ulen1, uchar2, ulen2, &status);
+	}
 	uspoof_close(sc);
 
 	if (U_FAILURE(status))
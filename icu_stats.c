@@ -0,0 +1,436 @@
+/*
+ * icu_stats.c
+ *
+ * Part of icu_ext: a PostgreSQL extension to expose functionality from ICU
+ * (see http://icu-project.org)
+ *
+ * By Daniel Vérité, 2018-2025. See LICENSE.md
+ */
+
+#include "icu_ext.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_language.h"
+#include "catalog/pg_proc.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+PG_FUNCTION_INFO_V1(icu_ext_stats);
+PG_FUNCTION_INFO_V1(icu_ext_stats_reset);
+
+/*
+ * Maximum number of entry points (C functions of the library) that
+ * can have statistics. Entry 0 collects the work that is not done
+ * inside a tracked call, for instance through sort support.
+ */
+#define ICU_EXT_MAX_ENTRIES 256
+
+/* Columns of icu_ext_stats(): function, calls, times, counters, shared */
+#define STATS_COLS (4 + ICU_STAT_COUNT + 1)
+
+typedef struct icu_ext_entry_stats
+{
+	char		name[NAMEDATALEN];	/* C symbol, empty for entry 0 */
+	pg_atomic_uint64 calls;
+	pg_atomic_uint64 total_time;	/* in microseconds */
+	pg_atomic_uint64 max_time;	/* in microseconds */
+	pg_atomic_uint64 counters[ICU_STAT_COUNT];
+} icu_ext_entry_stats;
+
+/*
+ * The statistics are in shared memory when icu_ext is loaded through
+ * shared_preload_libraries, and cover all the backends.
+ * Otherwise there is no shared memory to put them, and each backend
+ * only sees its own statistics.
+ */
+typedef struct icu_ext_shared_stats
+{
+	slock_t		mutex;			/* protects the creation of entries */
+	pg_atomic_uint32 nentries;
+	icu_ext_entry_stats entries[ICU_EXT_MAX_ENTRIES];
+} icu_ext_shared_stats;
+
+/*
+ * State of a tracked function, kept with its FmgrInfo by the
+ * fmgr hook.
+ */
+typedef struct icu_ext_call_state
+{
+	int			entry;			/* -1 if not a function of icu_ext */
+	int			prev_entry;
+	bool		active;
+	instr_time	start;
+	Datum		prev_arg;		/* for the previous fmgr_hook */
+} icu_ext_call_state;
+
+static icu_ext_shared_stats *stats = NULL;
+static bool stats_shared = false;
+
+/* Entry point to which the counters are attributed */
+static int	current_entry = 0;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static needs_fmgr_hook_type prev_needs_fmgr_hook = NULL;
+static fmgr_hook_type prev_fmgr_hook = NULL;
+
+bool icu_ext_track_functions = false;
+
+static void
+init_stats(icu_ext_shared_stats *s)
+{
+	SpinLockInit(&s->mutex);
+	pg_atomic_init_u32(&s->nentries, 1);
+	for (int i = 0; i < ICU_EXT_MAX_ENTRIES; i++)
+	{
+		icu_ext_entry_stats *e = &s->entries[i];
+
+		e->name[0] = '\0';
+		pg_atomic_init_u64(&e->calls, 0);
+		pg_atomic_init_u64(&e->total_time, 0);
+		pg_atomic_init_u64(&e->max_time, 0);
+		for (int j = 0; j < ICU_STAT_COUNT; j++)
+			pg_atomic_init_u64(&e->counters[j], 0);
+	}
+}
+
+/*
+ * Without shared memory, allocate the statistics of the backend
+ * on first use.
+ */
+static icu_ext_shared_stats *
+get_stats(void)
+{
+	if (stats == NULL)
+	{
+		stats = MemoryContextAlloc(TopMemoryContext,
+								   sizeof(icu_ext_shared_stats));
+		init_stats(stats);
+	}
+	return stats;
+}
+
+void
+icu_ext_stats_add(icu_ext_stat stat, uint64 n)
+{
+	icu_ext_shared_stats *s = get_stats();
+
+	pg_atomic_fetch_add_u64(&s->entries[current_entry].counters[stat], n);
+}
+
+/*
+ * Return the index of the entry of the C function @name, creating it
+ * if needed, or 0 if there is no room left.
+ */
+static int
+lookup_entry(const char *name)
+{
+	icu_ext_shared_stats *s = get_stats();
+	uint32		n = pg_atomic_read_u32(&s->nentries);
+	int			found = 0;
+
+	/* the name of an entry is written before nentries is advanced */
+	pg_read_barrier();
+	for (uint32 i = 1; i < n; i++)
+	{
+		if (strcmp(s->entries[i].name, name) == 0)
+			return i;
+	}
+
+	SpinLockAcquire(&s->mutex);
+	n = pg_atomic_read_u32(&s->nentries);
+	for (uint32 i = 1; i < n; i++)
+	{
+		if (strcmp(s->entries[i].name, name) == 0)
+		{
+			found = i;
+			break;
+		}
+	}
+	if (found == 0 && n < ICU_EXT_MAX_ENTRIES)
+	{
+		strlcpy(s->entries[n].name, name, NAMEDATALEN);
+		pg_write_barrier();
+		pg_atomic_write_u32(&s->nentries, n + 1);
+		found = n;
+	}
+	SpinLockRelease(&s->mutex);
+
+	return found;
+}
+
+/*
+ * Return whether @probin designates this library, as in
+ * '$libdir/icu_ext', with or without a suffix.
+ */
+static bool
+is_icu_ext_library(const char *probin)
+{
+	const char *base = strrchr(probin, '/');
+
+	base = (base != NULL) ? base + 1 : probin;
+
+	return strncmp(base, "icu_ext", 7) == 0 &&
+		(base[7] == '\0' || base[7] == '.');
+}
+
+/*
+ * Return the C symbol of the function @fn_oid if it belongs to this
+ * library, or NULL.
+ */
+static char *
+icu_ext_function_symbol(Oid fn_oid)
+{
+	HeapTuple	tuple;
+	Datum		datum;
+	bool		isnull;
+	char	   *symbol = NULL;
+
+	tuple = SearchSysCache1(PROCOID, ObjectIdGetDatum(fn_oid));
+	if (!HeapTupleIsValid(tuple))
+		return NULL;
+
+	if (((Form_pg_proc) GETSTRUCT(tuple))->prolang == ClanguageId)
+	{
+		datum = SysCacheGetAttr(PROCOID, tuple, Anum_pg_proc_probin, &isnull);
+		if (!isnull && is_icu_ext_library(TextDatumGetCString(datum)))
+		{
+			datum = SysCacheGetAttr(PROCOID, tuple, Anum_pg_proc_prosrc, &isnull);
+			if (!isnull)
+				symbol = TextDatumGetCString(datum);
+		}
+	}
+	ReleaseSysCache(tuple);
+
+	return symbol;
+}
+
+/*
+ * Have the functions of icu_ext called through icu_stats_fmgr_hook()
+ * when they are looked up while icu_ext.track_functions is on.
+ */
+static bool
+icu_stats_needs_fmgr_hook(Oid fn_oid)
+{
+	if (prev_needs_fmgr_hook && prev_needs_fmgr_hook(fn_oid))
+		return true;
+
+	return icu_ext_track_functions && icu_ext_function_symbol(fn_oid) != NULL;
+}
+
+static void
+icu_stats_fmgr_hook(FmgrHookEventType event, FmgrInfo *flinfo, Datum *arg)
+{
+	icu_ext_call_state *state = (icu_ext_call_state *) DatumGetPointer(*arg);
+
+	if (state == NULL)
+	{
+		char	   *symbol = icu_ext_function_symbol(flinfo->fn_oid);
+
+		state = MemoryContextAllocZero(flinfo->fn_mcxt,
+									   sizeof(icu_ext_call_state));
+		state->entry = (symbol != NULL) ? lookup_entry(symbol) : -1;
+		*arg = PointerGetDatum(state);
+	}
+
+	if (state->entry > 0)
+	{
+		if (event == FHET_START)
+		{
+			state->active = icu_ext_track_functions;
+			if (state->active)
+			{
+				state->prev_entry = current_entry;
+				current_entry = state->entry;
+				INSTR_TIME_SET_CURRENT(state->start);
+			}
+		}
+		else if (state->active)
+		{
+			icu_ext_entry_stats *e = &get_stats()->entries[state->entry];
+			instr_time	duration;
+			uint64		elapsed;
+			uint64		max;
+
+			INSTR_TIME_SET_CURRENT(duration);
+			INSTR_TIME_SUBTRACT(duration, state->start);
+			elapsed = INSTR_TIME_GET_MICROSEC(duration);
+
+			pg_atomic_fetch_add_u64(&e->calls, 1);
+			pg_atomic_fetch_add_u64(&e->total_time, elapsed);
+			max = pg_atomic_read_u64(&e->max_time);
+			while (elapsed > max &&
+				   !pg_atomic_compare_exchange_u64(&e->max_time, &max, elapsed))
+				;
+
+			current_entry = state->prev_entry;
+			state->active = false;
+		}
+	}
+
+	if (prev_fmgr_hook)
+		prev_fmgr_hook(event, flinfo, &state->prev_arg);
+}
+
+#if PG_VERSION_NUM >= 150000
+static void
+icu_stats_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(sizeof(icu_ext_shared_stats));
+}
+#endif
+
+static void
+icu_stats_shmem_startup(void)
+{
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	stats = ShmemInitStruct("icu_ext stats",
+							sizeof(icu_ext_shared_stats),
+							&found);
+	if (!found)
+		init_stats(stats);
+	stats_shared = true;
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Called by _PG_init(). Install the fmgr hooks that time the calls,
+ * and reserve the shared memory for the statistics when loaded by
+ * shared_preload_libraries.
+ */
+void
+icu_ext_stats_init(void)
+{
+	prev_needs_fmgr_hook = needs_fmgr_hook;
+	needs_fmgr_hook = icu_stats_needs_fmgr_hook;
+	prev_fmgr_hook = fmgr_hook;
+	fmgr_hook = icu_stats_fmgr_hook;
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = icu_stats_shmem_request;
+#else
+	RequestAddinShmemSpace(sizeof(icu_ext_shared_stats));
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = icu_stats_shmem_startup;
+}
+
+/*
+ * Return one row per entry point that has been called or has counted
+ * something: (function, calls, total_time, max_time, <counters>, shared).
+ * The times are in milliseconds.
+ */
+Datum
+icu_ext_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	icu_ext_shared_stats *s = get_stats();
+	uint32		n;
+	Datum values[STATS_COLS];
+	bool nulls[STATS_COLS];
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	n = pg_atomic_read_u32(&s->nentries);
+	pg_read_barrier();
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		icu_ext_entry_stats *e = &s->entries[i];
+		uint64 calls = pg_atomic_read_u64(&e->calls);
+		bool used = (calls > 0);
+		int col = 0;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		if (i == 0)
+			nulls[col++] = true;
+		else
+			values[col++] = CStringGetTextDatum(e->name);
+		values[col++] = Int64GetDatum((int64) calls);
+		values[col++] = Float8GetDatum(pg_atomic_read_u64(&e->total_time) / 1000.0);
+		values[col++] = Float8GetDatum(pg_atomic_read_u64(&e->max_time) / 1000.0);
+		for (int j = 0; j < ICU_STAT_COUNT; j++)
+		{
+			uint64 value = pg_atomic_read_u64(&e->counters[j]);
+
+			if (value > 0)
+				used = true;
+			values[col++] = Int64GetDatum((int64) value);
+		}
+		values[col++] = BoolGetDatum(stats_shared);
+
+		if (used)
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * Reset all the statistics to zero.
+ */
+Datum
+icu_ext_stats_reset(PG_FUNCTION_ARGS)
+{
+	icu_ext_shared_stats *s = get_stats();
+	uint32 n = pg_atomic_read_u32(&s->nentries);
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		icu_ext_entry_stats *e = &s->entries[i];
+
+		pg_atomic_write_u64(&e->calls, 0);
+		pg_atomic_write_u64(&e->total_time, 0);
+		pg_atomic_write_u64(&e->max_time, 0);
+		for (int j = 0; j < ICU_STAT_COUNT; j++)
+			pg_atomic_write_u64(&e->counters[j], 0);
+	}
+
+	PG_RETURN_VOID();
+}
@@ -94,6 +94,7 @@ icu_timestamptz_out(PG_FUNCTION_ARGS)
 					   &status);
 		if (U_FAILURE(status))
 			elog(ERROR, "udat_open failed with code %d\n", status);
+		ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 		{
 			/* Try first to convert into a buffer on the stack, and
 			   palloc() it only if udat_format says it's too small */
@@ -184,6 +185,7 @@ icu_timestamptz_in(PG_FUNCTION_ARGS)
 		udat_close(df);
 		elog(ERROR, "udat_open failed: %s\n", u_errorName(status));
 	}
+	ICU_EXT_COUNT(ICU_STAT_UDAT_OPEN, 1);
 
 	udat_setLenient(df, false);	/* strict parsing */
 
@@ -79,10 +79,11 @@ icu_transform(PG_FUNCTION_ARGS)
 	text *arg1 = PG_GETARG_TEXT_PP(0);
 	text *arg2 = PG_GETARG_TEXT_PP(1);
 	int32_t len1 = VARSIZE_ANY_EXHDR(arg1);
-	const char *input_id = text_to_cstring(arg2);
+	int32_t len2 = VARSIZE_ANY_EXHDR(arg2);
 	UErrorCode status = U_ZERO_ERROR;
 	int32_t ulen, limit, capacity, start, original_ulen;
 	int32_t result_len, in_ulen;
+	UChar local_buf[UCHAR_LOCAL_BUFSIZE];
 	UChar* utext;
 	UChar* trans_id;
 	char* result;
@@ -92,7 +93,9 @@ icu_transform(PG_FUNCTION_ARGS)
 
 	if (cached_utrans_id != NULL)
 	{
-		if (strcmp(cached_utrans_id, input_id) != 0)
+		/* compare the id in place, without copying it */
+		if (strlen(cached_utrans_id) != len2 ||
+			memcmp(cached_utrans_id, VARDATA_ANY(arg2), len2) != 0)
 		{
 			pfree(cached_utrans_id);
 			cached_utrans_id = NULL;
@@ -103,6 +106,9 @@ icu_transform(PG_FUNCTION_ARGS)
 
 	if (utrans == NULL)
 	{
+		const char *input_id = text_to_cstring(arg2);
+
+		ICU_EXT_COUNT(ICU_STAT_TRANSLITERATOR_CACHE_MISS, 1);
 		in_ulen = string_to_uchar(&trans_id, input_id, strlen(input_id));
 
 		utrans = utrans_openU(trans_id,
@@ -119,18 +125,21 @@ icu_transform(PG_FUNCTION_ARGS)
 		}
 		else
 		{
+			ICU_EXT_COUNT(ICU_STAT_UTRANS_OPEN, 1);
 			cached_utrans_id = MemoryContextStrdup(TopMemoryContext, input_id);
 		}
 	}
+	else
+		ICU_EXT_COUNT(ICU_STAT_TRANSLITERATOR_CACHE_HIT, 1);
 
-	ulen = string_to_uchar(&utext, text_to_cstring(arg1), len1);
-	/* utext is terminated by a zero UChar that we include in the copy. */
-	original = (UChar*) palloc((ulen+1)*sizeof(UChar));
+	ulen = string_to_uchar_scratch(&original, local_buf, 0, VARDATA_ANY(arg1), len1);
+	/* original is terminated by a zero UChar that we include in the copy. */
 	original_ulen = ulen;
-	memcpy(original, utext, (ulen+1)*sizeof(UChar));
+	capacity = ulen + 1;
+	utext = uchar_scratch_buffer(1, capacity);
+	memcpy(utext, original, (ulen+1)*sizeof(UChar));
 
 	limit = ulen;
-	capacity = ulen + 1;
 	start = 0;
 	/*
 	 * utrans_transUChars() updates the string in-place, stopping if
@@ -160,9 +169,8 @@ icu_transform(PG_FUNCTION_ARGS)
 			}
 			else
 			{
-				pfree(utext);
 				capacity = capacity * 2;
-				utext = (UChar*) palloc(capacity*sizeof(UChar));
+				utext = uchar_scratch_buffer(1, capacity);
 				/* restore the original text in the enlarged buffer */
 				ulen = original_ulen;
 				limit = ulen;
@@ -0,0 +1,193 @@
+/*
+ * icu_tsearch.c
+ *
+ * Part of icu_ext: a PostgreSQL extension to expose functionality from ICU
+ * (see http://icu-project.org)
+ *
+ * By Daniel Vérité, 2018-2025. See LICENSE.md
+ */
+
+#include "icu_ext.h"
+
+#include "mb/pg_wchar.h"
+#include "tsearch/ts_public.h"
+#include "utils/builtins.h"
+
+#include "unicode/ubrk.h"
+#include "unicode/utext.h"
+
+/*
+ * Text search parser splitting words with ICU word break iterators,
+ * which segment scripts written without spaces (Thai, Lao, Khmer,
+ * Burmese, Chinese, Japanese) with dictionaries.
+ */
+
+PG_FUNCTION_INFO_V1(icu_tsparser_start);
+PG_FUNCTION_INFO_V1(icu_tsparser_gettoken);
+PG_FUNCTION_INFO_V1(icu_tsparser_end);
+PG_FUNCTION_INFO_V1(icu_tsparser_lextype);
+
+/*
+ * Locale of the word break iterator, the root locale if empty.
+ * Each parser sets it with the SET clause of its start function, so
+ * that its results do not depend on the session.
+ */
+char *icu_ext_tsearch_locale = NULL;
+
+/*
+ * Token types, from the categories of rule statuses of word
+ * boundaries (see UWordBreak).
+ * The headline function of the default parser, prsd_headline(), is
+ * used with these types, and it has the ids of the default parser
+ * built in: spaces must be 12 (SPACE), and words must avoid the ids
+ * that it skips or replaces (5, 13, 15, 16, 17).
+ */
+#define TOKEN_WORD		1		/* UBRK_WORD_LETTER */
+#define TOKEN_NUMBER	2		/* UBRK_WORD_NUMBER */
+#define TOKEN_KANA		3		/* UBRK_WORD_KANA */
+#define TOKEN_IDEO		4		/* UBRK_WORD_IDEO */
+#define TOKEN_BLANK		12		/* UBRK_WORD_NONE */
+
+static const struct
+{
+	int			id;
+	const char *name;
+	const char *descr;
+}			token_types[] = {
+	{TOKEN_WORD, "word", "Word, letters"},
+	{TOKEN_NUMBER, "number", "Number"},
+	{TOKEN_KANA, "kana", "Word, kana"},
+	{TOKEN_IDEO, "ideo", "Word, ideographic"},
+	{TOKEN_BLANK, "blank", "Space or punctuation"}
+};
+
+typedef struct
+{
+	char	   *str;			/* text being parsed, in the database encoding */
+	UChar	   *cnv_text;		/* NULL if the database encoding is UTF-8 */
+	UText	   *ut;
+	UBreakIterator *iter;
+	int32_t		pos;			/* offset of the iterator */
+	int			byte_pos;		/* offset in str, if converted */
+} icu_tsparser_state;
+
+Datum
+icu_tsparser_start(PG_FUNCTION_ARGS)
+{
+	icu_tsparser_state *state = palloc(sizeof(icu_tsparser_state));
+	int			len = PG_GETARG_INT32(1);
+	const char *locale = icu_ext_tsearch_locale ? icu_ext_tsearch_locale : "";
+	UErrorCode	status = U_ZERO_ERROR;
+
+	state->str = (char *) PG_GETARG_POINTER(0);
+	state->pos = 0;
+	state->byte_pos = 0;
+	state->iter = open_break_iterator(UBRK_WORD, locale);
+
+	/*
+	 * The converted text is kept outside of the scratch buffers, which
+	 * may be used by dictionaries between calls.
+	 */
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		state->cnv_text = NULL;
+		state->ut = utext_openUTF8(NULL, state->str, len, &status);
+	}
+	else
+	{
+		int32_t ulen = string_to_uchar(&state->cnv_text, state->str, len);
+
+		state->ut = utext_openUChars(NULL, state->cnv_text, ulen, &status);
+	}
+	if (U_FAILURE(status))
+	{
+		ubrk_close(state->iter);
+		elog(ERROR, "utext_open failed: %s", u_errorName(status));
+	}
+
+	ubrk_setUText(state->iter, state->ut, &status);
+	if (U_FAILURE(status))
+	{
+		ubrk_close(state->iter);
+		utext_close(state->ut);
+		elog(ERROR, "ubrk_setText() failed: %s", u_errorName(status));
+	}
+
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * Return the type of the next token, with its position and length
+ * in bytes in the 2nd and 3rd arguments, or 0 at the end of the text.
+ */
+Datum
+icu_tsparser_gettoken(PG_FUNCTION_ARGS)
+{
+	icu_tsparser_state *state = (icu_tsparser_state *) PG_GETARG_POINTER(0);
+	char	  **t = (char **) PG_GETARG_POINTER(1);
+	int		   *tlen = (int *) PG_GETARG_POINTER(2);
+	int32_t		pos1 = ubrk_next(state->iter);
+	int32_t		rule_status;
+
+	if (pos1 == UBRK_DONE)
+		PG_RETURN_INT32(0);
+
+	if (state->cnv_text == NULL)
+	{
+		*t = state->str + state->pos;
+		*tlen = pos1 - state->pos;
+	}
+	else
+	{
+		*t = state->str + state->byte_pos;
+		*tlen = string_from_uchar_length(state->cnv_text + state->pos,
+										 pos1 - state->pos);
+		state->byte_pos += *tlen;
+	}
+	state->pos = pos1;
+
+	rule_status = ubrk_getRuleStatus(state->iter);
+	if (rule_status < UBRK_WORD_NONE_LIMIT)
+		PG_RETURN_INT32(TOKEN_BLANK);
+	else if (rule_status < UBRK_WORD_NUMBER_LIMIT)
+		PG_RETURN_INT32(TOKEN_NUMBER);
+	else if (rule_status < UBRK_WORD_LETTER_LIMIT)
+		PG_RETURN_INT32(TOKEN_WORD);
+	else if (rule_status < UBRK_WORD_KANA_LIMIT)
+		PG_RETURN_INT32(TOKEN_KANA);
+	else if (rule_status < UBRK_WORD_IDEO_LIMIT)
+		PG_RETURN_INT32(TOKEN_IDEO);
+	else
+		PG_RETURN_INT32(TOKEN_WORD);	/* custom rules */
+}
+
+Datum
+icu_tsparser_end(PG_FUNCTION_ARGS)
+{
+	icu_tsparser_state *state = (icu_tsparser_state *) PG_GETARG_POINTER(0);
+
+	ubrk_close(state->iter);
+	utext_close(state->ut);
+	if (state->cnv_text != NULL)
+		pfree(state->cnv_text);
+	pfree(state);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+icu_tsparser_lextype(PG_FUNCTION_ARGS)
+{
+	int			ntypes = lengthof(token_types);
+	LexDescr   *descr = (LexDescr *) palloc(sizeof(LexDescr) * (ntypes + 1));
+
+	for (int i = 0; i < ntypes; i++)
+	{
+		descr[i].lexid = token_types[i].id;
+		descr[i].alias = pstrdup(token_types[i].name);
+		descr[i].descr = pstrdup(token_types[i].descr);
+	}
+	descr[ntypes].lexid = 0;
+
+	PG_RETURN_POINTER(descr);
+}
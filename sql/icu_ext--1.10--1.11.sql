@@ -0,0 +1,688 @@
+-- complain if script is sourced in psql, rather than via CREATE/ALTER EXTENSION
+\echo Use "ALTER EXTENSION icu_ext UPDATE TO '1.11'" to load this file. \quit
+
+---
+--- icu_text_ops: btree operator class for text, collating with
+--- the ICU collation of the arguments like icu_compare(text,text)
+---
+
+CREATE FUNCTION icu_text_lt(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_lt'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_le(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_le'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_eq(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_eq'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_ne(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_ne'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_ge(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_ge'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_gt(text, text) RETURNS bool
+AS 'MODULE_PATHNAME', 'icu_text_gt'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_text_sortsupport(internal) RETURNS void
+AS 'MODULE_PATHNAME', 'icu_text_sortsupport'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE OPERATOR #<# (
+ PROCEDURE = icu_text_lt,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#>#',
+ NEGATOR = '#>=#',
+ RESTRICT = scalarltsel,
+ JOIN = scalarltjoinsel
+);
+
+CREATE OPERATOR #<=# (
+ PROCEDURE = icu_text_le,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#>=#',
+ NEGATOR = '#>#',
+ RESTRICT = scalarlesel,
+ JOIN = scalarlejoinsel
+);
+
+CREATE OPERATOR #=# (
+ PROCEDURE = icu_text_eq,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#=#',
+ NEGATOR = '#<>#',
+ RESTRICT = eqsel,
+ JOIN = eqjoinsel,
+ MERGES,
+ HASHES
+);
+
+CREATE OPERATOR #<># (
+ PROCEDURE = icu_text_ne,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#<>#',
+ NEGATOR = '#=#',
+ RESTRICT = neqsel,
+ JOIN = neqjoinsel
+);
+
+CREATE OPERATOR #>=# (
+ PROCEDURE = icu_text_ge,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#<=#',
+ NEGATOR = '#<#',
+ RESTRICT = scalargesel,
+ JOIN = scalargejoinsel
+);
+
+CREATE OPERATOR #># (
+ PROCEDURE = icu_text_gt,
+ LEFTARG = text,
+ RIGHTARG = text,
+ COMMUTATOR = '#<#',
+ NEGATOR = '#<=#',
+ RESTRICT = scalargtsel,
+ JOIN = scalargtjoinsel
+);
+
+CREATE OPERATOR CLASS icu_text_ops
+FOR TYPE text USING btree AS
+OPERATOR 1 #<#,
+OPERATOR 2 #<=#,
+OPERATOR 3 #=#,
+OPERATOR 4 #>=#,
+OPERATOR 5 #>#,
+FUNCTION 1 icu_compare(text, text),
+FUNCTION 2 icu_text_sortsupport(internal);
+
+COMMENT ON OPERATOR CLASS icu_text_ops USING btree
+IS 'Order strings like icu_compare() with the ICU collation of the arguments';
+
+CREATE FUNCTION icu_sort_key(
+ str text,
+ max_bytes int
+) RETURNS bytea
+AS 'MODULE_PATHNAME', 'icu_sort_key_prefix'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE COST 10;
+
+COMMENT ON FUNCTION icu_sort_key(text,int)
+ IS 'Compute the first bytes of the binary sort key with the collate of the string';
+
+CREATE FUNCTION icu_sort_key(
+ str text,
+ collator text,
+ max_bytes int
+) RETURNS bytea
+AS 'MODULE_PATHNAME', 'icu_sort_key_prefix_coll'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE COST 10;
+
+COMMENT ON FUNCTION icu_sort_key(text,text,int)
+ IS 'Compute the first bytes of the binary sort key for the string given the collation';
+
+CREATE FUNCTION icu_sort_keys(
+ strs text[]
+) RETURNS bytea[]
+AS 'MODULE_PATHNAME', 'icu_sort_keys'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_sort_keys(text[])
+ IS 'Compute the binary sort keys of an array of strings with their collation';
+
+CREATE FUNCTION icu_sort_keys(
+ strs text[],
+ collator text
+) RETURNS bytea[]
+AS 'MODULE_PATHNAME', 'icu_sort_keys_coll'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_sort_keys(text[],text)
+ IS 'Compute the binary sort keys of an array of strings given the collation';
+
+CREATE FUNCTION icu_hash(
+ str text
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_hash'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_hash(text)
+ IS 'Compute a hash value of the string from its sort key with its collation';
+
+CREATE FUNCTION icu_hash(
+ str text,
+ collator text
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_hash_coll'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_hash(text,text)
+ IS 'Compute a hash value of the string from its sort key given the collation';
+
+CREATE FUNCTION icu_hash_extended(
+ str text,
+ seed int8
+) RETURNS int8
+AS 'MODULE_PATHNAME', 'icu_hash_extended'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_hash_extended(text,int8)
+ IS 'Compute a seeded 64-bit hash value of the string from its sort key with its collation';
+
+CREATE FUNCTION icu_hash_extended(
+ str text,
+ collator text,
+ seed int8
+) RETURNS int8
+AS 'MODULE_PATHNAME', 'icu_hash_extended_coll'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_hash_extended(text,text,int8)
+ IS 'Compute a seeded 64-bit hash value of the string from its sort key given the collation';
+
+---
+--- icu_text_hash_ops: hash operator class for text, consistent
+--- with the equality of icu_text_ops
+---
+
+CREATE OPERATOR CLASS icu_text_hash_ops
+FOR TYPE text USING hash AS
+OPERATOR 1 #=#,
+FUNCTION 1 icu_hash(text),
+FUNCTION 2 icu_hash_extended(text, int8);
+
+COMMENT ON OPERATOR CLASS icu_text_hash_ops USING hash
+IS 'Hash strings consistently with the equality of their ICU collation';
+
+---
+--- icu_sortkey datatype: binary sort keys compared with memcmp()
+---
+
+CREATE FUNCTION icu_sortkey_in(cstring) RETURNS icu_sortkey
+LANGUAGE internal AS 'byteain' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_out(icu_sortkey) RETURNS cstring
+LANGUAGE internal AS 'byteaout' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_recv(internal) RETURNS icu_sortkey
+LANGUAGE internal AS 'bytearecv' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_send(icu_sortkey) RETURNS bytea
+LANGUAGE internal AS 'byteasend' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE icu_sortkey (
+ INPUT = icu_sortkey_in,
+ OUTPUT = icu_sortkey_out,
+ RECEIVE = icu_sortkey_recv,
+ SEND = icu_sortkey_send,
+ LIKE = pg_catalog.bytea
+);
+
+CREATE FUNCTION icu_sortkey_eq (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'byteaeq' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_ne (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'byteane' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_gt (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'byteagt' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_ge (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'byteage' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_lt (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'bytealt' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_le (icu_sortkey, icu_sortkey) RETURNS bool
+LANGUAGE internal AS 'byteale' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_cmp (icu_sortkey, icu_sortkey) RETURNS int4
+LANGUAGE internal AS 'byteacmp' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_hash (icu_sortkey) RETURNS int4
+LANGUAGE internal AS 'hashvarlena' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_hash_extended (icu_sortkey, int8) RETURNS int8
+LANGUAGE internal AS 'hashvarlenaextended' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_sortkey_sortsupport(internal) RETURNS void
+AS 'MODULE_PATHNAME', 'icu_sortkey_sortsupport'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE OPERATOR = (
+ PROCEDURE = icu_sortkey_eq,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '=',
+ NEGATOR = '<>',
+ RESTRICT = eqsel,
+ JOIN = eqjoinsel,
+ HASHES, MERGES
+);
+
+CREATE OPERATOR <> (
+ PROCEDURE = icu_sortkey_ne,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '<>',
+ NEGATOR = '=',
+ RESTRICT = neqsel,
+ JOIN = neqjoinsel
+);
+
+CREATE OPERATOR > (
+ PROCEDURE = icu_sortkey_gt,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '<',
+ NEGATOR = '<=',
+ RESTRICT = scalargtsel,
+ JOIN = scalargtjoinsel
+);
+
+CREATE OPERATOR >= (
+ PROCEDURE = icu_sortkey_ge,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '<=',
+ NEGATOR = '<',
+ RESTRICT = scalargesel,
+ JOIN = scalargejoinsel
+);
+
+CREATE OPERATOR < (
+ PROCEDURE = icu_sortkey_lt,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '>',
+ NEGATOR = '>=',
+ RESTRICT = scalarltsel,
+ JOIN = scalarltjoinsel
+);
+
+CREATE OPERATOR <= (
+ PROCEDURE = icu_sortkey_le,
+ LEFTARG = icu_sortkey,
+ RIGHTARG = icu_sortkey,
+ COMMUTATOR = '>=',
+ NEGATOR = '>',
+ RESTRICT = scalarlesel,
+ JOIN = scalarlejoinsel
+);
+
+CREATE OPERATOR CLASS icu_sortkey_ops
+DEFAULT FOR TYPE icu_sortkey
+USING btree AS
+OPERATOR 1 <,
+OPERATOR 2 <=,
+OPERATOR 3 =,
+OPERATOR 4 >=,
+OPERATOR 5 >,
+FUNCTION 1 icu_sortkey_cmp(icu_sortkey, icu_sortkey),
+FUNCTION 2 icu_sortkey_sortsupport(internal);
+
+CREATE OPERATOR CLASS icu_sortkey_hash_ops
+DEFAULT FOR TYPE icu_sortkey
+USING hash AS
+OPERATOR 1 =,
+FUNCTION 1 icu_sortkey_hash(icu_sortkey),
+FUNCTION 2 icu_sortkey_hash_extended(icu_sortkey, int8);
+
+CREATE CAST (bytea AS icu_sortkey) WITHOUT FUNCTION AS ASSIGNMENT;
+CREATE CAST (icu_sortkey AS bytea) WITHOUT FUNCTION AS IMPLICIT;
+
+CREATE FUNCTION icu_compare_rules(
+ string1 text,
+ string2 text,
+ rules text
+) RETURNS int
+AS 'MODULE_PATHNAME', 'icu_compare_rules'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_compare_rules(text,text,text)
+ IS 'Compare two strings with a collation built from tailoring rules';
+
+CREATE FUNCTION icu_sort_key_rules(
+ str text,
+ rules text
+) RETURNS bytea
+AS 'MODULE_PATHNAME', 'icu_sort_key_rules'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_sort_key_rules(text,text)
+ IS 'Compute the binary sort key for the string with a collation built from tailoring rules';
+
+CREATE FUNCTION icu_ext_stats(
+ OUT function text,
+ OUT calls int8,
+ OUT total_time float8,
+ OUT max_time float8,
+ OUT bytes_to_uchar int8,
+ OUT bytes_from_uchar int8,
+ OUT ucol_open int8,
+ OUT udat_open int8,
+ OUT ucal_open int8,
+ OUT ubrk_open int8,
+ OUT usearch_open int8,
+ OUT uspoof_open int8,
+ OUT utrans_open int8,
+ OUT unum_open int8,
+ OUT collator_cache_hits int8,
+ OUT collator_cache_misses int8,
+ OUT transliterator_cache_hits int8,
+ OUT transliterator_cache_misses int8,
+ OUT break_iterator_cache_hits int8,
+ OUT break_iterator_cache_misses int8,
+ OUT shared bool
+)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'icu_ext_stats'
+LANGUAGE C;
+
+COMMENT ON FUNCTION icu_ext_stats()
+ IS 'Per-function statistics collected when icu_ext.track_functions is on';
+
+CREATE FUNCTION icu_ext_stats_reset() RETURNS void
+AS 'MODULE_PATHNAME', 'icu_ext_stats_reset'
+LANGUAGE C;
+
+COMMENT ON FUNCTION icu_ext_stats_reset()
+ IS 'Reset the statistics reported by icu_ext_stats()';
+
+REVOKE ALL ON FUNCTION icu_ext_stats_reset() FROM PUBLIC;
+
+---
+--- icu_nfc_text datatype: text normalized in NFC on input
+---
+
+CREATE FUNCTION icu_nfc_text_in(cstring) RETURNS icu_nfc_text
+AS 'MODULE_PATHNAME', 'icu_nfc_text_in'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_nfc_text_out(icu_nfc_text) RETURNS cstring
+LANGUAGE internal AS 'textout' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION icu_nfc_text_recv(internal) RETURNS icu_nfc_text
+AS 'MODULE_PATHNAME', 'icu_nfc_text_recv'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE FUNCTION icu_nfc_text_send(icu_nfc_text) RETURNS bytea
+LANGUAGE internal AS 'textsend' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE icu_nfc_text (
+ INPUT = icu_nfc_text_in,
+ OUTPUT = icu_nfc_text_out,
+ RECEIVE = icu_nfc_text_recv,
+ SEND = icu_nfc_text_send,
+ LIKE = pg_catalog.text,
+ CATEGORY = 'S',
+ COLLATABLE = true
+);
+
+COMMENT ON TYPE icu_nfc_text
+ IS 'Text in Unicode Normalization Form C';
+
+CREATE FUNCTION icu_nfc_text(text) RETURNS icu_nfc_text
+AS 'MODULE_PATHNAME', 'icu_nfc_text_from_text'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+CREATE CAST (text AS icu_nfc_text) WITH FUNCTION icu_nfc_text(text) AS ASSIGNMENT;
+CREATE CAST (icu_nfc_text AS text) WITHOUT FUNCTION AS IMPLICIT;
+
+CREATE FUNCTION icu_normalize(
+ string icu_nfc_text,
+ form text
+) RETURNS text
+AS 'MODULE_PATHNAME', 'icu_nfc_text_normalize'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_normalize(icu_nfc_text,text)
+IS 'Normalize the string into one of NFC, NFD, NFKC or NFKD Unicode forms';
+
+CREATE FUNCTION icu_is_normalized(
+ string icu_nfc_text,
+ form text
+) RETURNS boolean
+AS 'MODULE_PATHNAME', 'icu_nfc_text_is_normalized'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_is_normalized(icu_nfc_text,text)
+IS 'Test if the string is normalized in one of NFC, NFD, NFKC or NFKD Unicode forms';
+
+CREATE FUNCTION icu_grapheme_count(
+ contents text
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_grapheme_count'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_grapheme_count(text)
+ IS 'Count the grapheme clusters (user-perceived characters) in the text';
+
+CREATE FUNCTION icu_word_count(
+ contents text,
+ locale text
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_word_count'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_word_count(text,text)
+ IS 'Count the words in the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_word_count(
+ contents text,
+ locale text,
+ categories text[]
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_word_count'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_word_count(text,text,text[])
+ IS 'Count the words of the given categories in the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_sentence_count(
+ contents text,
+ locale text
+) RETURNS int4
+AS 'MODULE_PATHNAME', 'icu_sentence_count'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_sentence_count(text,text)
+ IS 'Count the sentences in the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_character_offsets(
+ contents text,
+ locale text,
+ bytes bool DEFAULT false
+) RETURNS int4[]
+AS 'MODULE_PATHNAME', 'icu_character_offsets'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_character_offsets(text,text,bool)
+ IS 'Positions of the ends of the characters of the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_word_offsets(
+ contents text,
+ locale text,
+ bytes bool DEFAULT false,
+ OUT offsets int4[],
+ OUT tags int4[]
+) RETURNS record
+AS 'MODULE_PATHNAME', 'icu_word_offsets'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_word_offsets(text,text,bool)
+ IS 'Positions of the ends of the words and non-words of the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_line_offsets(
+ contents text,
+ locale text,
+ bytes bool DEFAULT false,
+ OUT offsets int4[],
+ OUT tags int4[]
+) RETURNS record
+AS 'MODULE_PATHNAME', 'icu_line_offsets'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_line_offsets(text,text,bool)
+ IS 'Positions in the text where line breaks may occur, using rules of the specified locale';
+
+CREATE FUNCTION icu_sentence_offsets(
+ contents text,
+ locale text,
+ bytes bool DEFAULT false,
+ OUT offsets int4[],
+ OUT tags int4[]
+) RETURNS record
+AS 'MODULE_PATHNAME', 'icu_sentence_offsets'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_sentence_offsets(text,text,bool)
+ IS 'Positions of the ends of the sentences of the text, according to Unicode rules with the specified locale';
+
+CREATE FUNCTION icu_word_boundaries(
+  contents text,
+  locale text,
+  categories text[],
+  OUT tag int,
+  OUT contents text
+) RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'icu_word_boundaries'
+LANGUAGE C STRICT;
+
+COMMENT ON FUNCTION icu_word_boundaries(text,text,text[])
+ IS 'Split text into words of the given categories, using boundary positions according to Unicode rules with the specified locale';
+
+---
+--- Text search parser based on ICU word boundaries
+---
+
+-- The locale is fixed by the function, whatever the session settings
+CREATE FUNCTION icu_tsparser_start(internal, int4) RETURNS internal
+AS 'MODULE_PATHNAME', 'icu_tsparser_start'
+LANGUAGE C STRICT
+SET icu_ext.tsearch_locale = '';
+
+CREATE FUNCTION icu_tsparser_gettoken(internal, internal, internal) RETURNS internal
+AS 'MODULE_PATHNAME', 'icu_tsparser_gettoken'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION icu_tsparser_end(internal) RETURNS void
+AS 'MODULE_PATHNAME', 'icu_tsparser_end'
+LANGUAGE C STRICT;
+
+CREATE FUNCTION icu_tsparser_lextype(internal) RETURNS internal
+AS 'MODULE_PATHNAME', 'icu_tsparser_lextype'
+LANGUAGE C STRICT;
+
+CREATE TEXT SEARCH PARSER icu_parser (
+ START = icu_tsparser_start,
+ GETTOKEN = icu_tsparser_gettoken,
+ END = icu_tsparser_end,
+ HEADLINE = pg_catalog.prsd_headline,
+ LEXTYPES = icu_tsparser_lextype
+);
+
+COMMENT ON TEXT SEARCH PARSER icu_parser
+ IS 'Text search parser splitting words at ICU word boundaries';
+
+CREATE TEXT SEARCH CONFIGURATION icu (PARSER = icu_parser);
+
+ALTER TEXT SEARCH CONFIGURATION icu
+ ADD MAPPING FOR word, number, kana, ideo WITH simple;
+
+COMMENT ON TEXT SEARCH CONFIGURATION icu
+ IS 'Text search configuration with ICU word boundaries and the simple dictionary';
+
+---
+--- Boundaries with custom break rules
+---
+
+CREATE FUNCTION icu_boundaries_rules(
+  contents text,
+  rules text,
+  OUT tag int,
+  OUT contents text
+) RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'icu_boundaries_rules'
+LANGUAGE C STRICT;
+
+COMMENT ON FUNCTION icu_boundaries_rules(text,text)
+ IS 'Split text using boundary positions according to custom break rules';
+
+CREATE FUNCTION icu_break_rules_compile(rules text) RETURNS bytea
+AS 'MODULE_PATHNAME', 'icu_break_rules_compile'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_break_rules_compile(text)
+ IS 'Compile break rules into their binary form';
+
+CREATE TABLE icu_break_rules(
+  name text PRIMARY KEY,
+  rules text NOT NULL,
+  binary_rules bytea,
+  icu_version text
+);
+
+COMMENT ON TABLE icu_break_rules
+ IS 'Named break rules, with their binary form compiled on insert and update';
+
+CREATE FUNCTION icu_break_rules_trigger() RETURNS trigger
+AS 'MODULE_PATHNAME', 'icu_break_rules_trigger'
+LANGUAGE C;
+
+CREATE TRIGGER icu_break_rules_compile
+ BEFORE INSERT OR UPDATE ON icu_break_rules
+ FOR EACH ROW EXECUTE PROCEDURE icu_break_rules_trigger();
+
+-- Readable by all, for icu_boundaries_named_rules(). Writes stay with
+-- the owner, since ICU trusts the binary rules produced by the trigger.
+GRANT SELECT ON icu_break_rules TO PUBLIC;
+
+SELECT pg_catalog.pg_extension_config_dump('icu_break_rules', '');
+
+CREATE FUNCTION icu_boundaries_named_rules(
+  contents text,
+  name text,
+  OUT tag int,
+  OUT contents text
+) RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'icu_boundaries_named_rules'
+LANGUAGE C STRICT STABLE;
+
+COMMENT ON FUNCTION icu_boundaries_named_rules(text,text)
+ IS 'Split text using boundary positions according to break rules registered in icu_break_rules';
+
+---
+--- Line wrapping
+---
+
+CREATE FUNCTION icu_wrap(
+  contents text,
+  width int4,
+  locale text
+) RETURNS text
+AS 'MODULE_PATHNAME', 'icu_wrap'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_wrap(text,int4,text)
+ IS 'Wrap text into lines of the given display width at line break opportunities according to the locale';
+
+CREATE FUNCTION icu_wrap_lines(
+  contents text,
+  width int4,
+  locale text
+) RETURNS text[]
+AS 'MODULE_PATHNAME', 'icu_wrap_lines'
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE;
+
+COMMENT ON FUNCTION icu_wrap_lines(text,int4,text)
+ IS 'Wrap text into an array of lines of the given display width at line break opportunities according to the locale';
@@ -8,6 +8,25 @@ SELECT collname FROM pg_collation WHERE collname IN
  ('und-x-icu', 'en-x-icu')
 ORDER BY collname;
 
+-- icu_boundaries_rules
+SELECT * FROM icu_boundaries_rules('abc 12,de',
+  '$w=[a-z]+; $d=[0-9]+; $w {200}; $d {100}; [^a-z0-9] {0};');
+
+-- icu_break_rules
+INSERT INTO icu_break_rules(name, rules)
+  VALUES('words_digits', '$w=[a-z]+; $d=[0-9]+; $w {200}; $d {100}; [^a-z0-9] {0};');
+SELECT name, binary_rules = icu_break_rules_compile(rules) AS compiled,
+       icu_version IS NOT NULL AS has_version
+  FROM icu_break_rules;
+SELECT * FROM icu_boundaries_named_rules('abc 12,de', 'words_digits');
+SELECT * FROM icu_boundaries_named_rules('abc', 'unknown');
+CREATE ROLE regress_icu_ext_user;
+SET ROLE regress_icu_ext_user;
+SELECT * FROM icu_boundaries_named_rules('abc 12', 'words_digits');
+RESET ROLE;
+DROP ROLE regress_icu_ext_user;
+DELETE FROM icu_break_rules;
+
 -- icu_char_name
 SELECT c, to_hex(ascii(c)), icu_char_name(c)
    FROM regexp_split_to_table('El Niño', '') as c;
@@ -15,6 +34,10 @@ SELECT c, to_hex(ascii(c)), icu_char_name(c)
 -- icu_character_boundaries
 SELECT * FROM icu_character_boundaries('Ete'||E'\u0301', 'fr') as chars;
 
+-- icu_character_offsets
+SELECT icu_character_offsets('Ete'||E'\u0301', 'en') AS chars,
+       icu_character_offsets('Ete'||E'\u0301', 'en', true) AS bytes;
+
 -- icu_collation_attributes
 SELECT * FROM icu_collation_attributes('en') WHERE attribute <> 'version';
 
@@ -22,6 +45,10 @@ SELECT * FROM icu_collation_attributes('en') WHERE attribute <> 'version';
 SELECT icu_compare('abcé', 'abce', 'en@colStrength=primary;colCaseLevel=yes');
 SELECT icu_compare('Abcé', 'abce' COLLATE "en-x-icu");
 
+-- icu_compare_rules
+SELECT icu_compare_rules('z', 'b', '&a < z') AS tailored,
+       icu_compare('z', 'b', 'und') AS root;
+
 -- icu_confusable_strings_check
 SELECT txt, icu_confusable_strings_check('phil', txt) AS confusable
     FROM (VALUES ('phiL'), ('phiI'), ('phi1'), (E'ph\u0131l')) AS s(txt);
@@ -30,6 +57,30 @@ SELECT txt, icu_confusable_strings_check('phil', txt) AS confusable
 SELECT txt, icu_confusable_string_skeleton(txt) AS skeleton
     FROM (VALUES ('phiL'), ('phiI'), ('phi1'), (E'ph\u0131l'), (E'\u2026\u2026')) AS s(txt);
 
+-- icu_ext_stats
+SET icu_ext.track_functions TO on;
+SELECT icu_ext_stats_reset();
+SELECT icu_compare('a', 'b', 'fi-u-ks-level2'), icu_compare('b', 'a', 'fi-u-ks-level2');
+SELECT count(*) FROM icu_word_boundaries('a b', 'th'), icu_word_boundaries('c d', 'th');
+SELECT function, calls, ucol_open, collator_cache_hits, collator_cache_misses,
+       ubrk_open, break_iterator_cache_hits, break_iterator_cache_misses,
+       max_time <= total_time AS timed
+ FROM icu_ext_stats()
+ WHERE function IN ('icu_compare_coll', 'icu_word_boundaries')
+ ORDER BY function;
+RESET icu_ext.track_functions;
+
+-- icu_grapheme_count
+SELECT icu_grapheme_count('plain ascii') AS ascii,
+       icu_grapheme_count(E'a\r\nb') AS crlf,
+       icu_grapheme_count('Ete'||E'\u0301') AS combining;
+
+-- icu_hash
+SELECT icu_hash('Été', 'fr-u-ks-level1') = icu_hash('ete', 'fr-u-ks-level1') AS eq_level1,
+       icu_hash('Abc' COLLATE "en-x-icu") = icu_hash('abc' COLLATE "en-x-icu") AS eq_tertiary,
+       icu_hash_extended('Été', 'fr-u-ks-level1', 42)
+        = icu_hash_extended('ete', 'fr-u-ks-level1', 42) AS eq_extended;
+
 -- icu_line_boundaries
 SELECT *,convert_to( contents, 'utf-8')
 FROM icu_line_boundaries(
@@ -40,6 +91,22 @@ Yet if hope has flown away
 In a night, or in a day,$$
 , 'en');
 
+-- icu_line_offsets
+SELECT * FROM icu_line_offsets('Hello, world!', 'en');
+
+-- icu_nfc_text
+SELECT E'éte'::icu_nfc_text::text = E'éte' AS input,
+       octet_length(E'é'::text::icu_nfc_text) AS len,
+       icu_normalize(E'é'::icu_nfc_text, 'NFD') = E'é' AS nfd,
+       icu_is_normalized(E'été'::icu_nfc_text, 'NFC') AS is_nfc;
+
+-- icu_normalize
+SELECT icu_normalize(E'Bénéfice', 'NFC') = E'Bénéfice' AS nfc,
+       icu_normalize(E'café crème', 'NFD') = E'café crème' AS nfd,
+       icu_normalize(E'ﬁn', 'NFKC') AS nfkc,
+       icu_normalize('plain ascii', 'NFKD') AS ascii,
+       icu_is_normalized(E'é', 'NFC') AS is_nfc;
+
 -- icu_number_spellout
 /* use the unaligned format for this test. With the aligned format,
    there are environment-related differences in how psql computes
@@ -49,6 +116,11 @@ SELECT loc, icu_number_spellout(1234, loc)
     FROM (values ('en'),('fr'),('de'),('ru'),('ja')) AS s(loc);
 \pset format aligned
 
+-- icu_parser
+SELECT * FROM ts_parse('icu_parser', 'Hello 42 世界. สวัสดีครับ');
+SELECT to_tsvector('icu', 'Hello 42 世界. สวัสดีครับ');
+SELECT ts_headline('icu', 'Hello, wonderful world!', to_tsquery('icu', 'world'));
+
 -- icu_replace
 SELECT n,
    icu_replace(
@@ -63,12 +135,49 @@ ORDER BY n COLLATE "C";
 SELECT * FROM icu_sentence_boundaries('Call me Mr. Brown. It''s a movie.',
  'en@ss=standard');
 
+-- icu_sentence_count
+SELECT icu_sentence_count('Call me Mr. Brown. It''s a movie.', 'en@ss=standard');
+
+-- icu_sentence_offsets
+SELECT * FROM icu_sentence_offsets('Call me Mr. Brown. It''s a movie.',
+ 'en@ss=standard');
+
+-- icu_sort_key
+SELECT icu_sort_key('Été', 'fr', 3) = substring(icu_sort_key('Été', 'fr') from 1 for 3) AS prefix,
+       icu_sort_key('Été', 'fr', 1000) = icu_sort_key('Été', 'fr') AS full_key,
+       length(icu_sort_key('Été' COLLATE "und-x-icu", 2)) AS len;
+
+-- icu_sort_key_rules
+SELECT icu_sort_key_rules('z', '&a < z') < icu_sort_key_rules('b', '&a < z') AS tailored,
+       icu_sort_key_rules('Été', '&e < x') = icu_sort_key('Été', 'und') AS same_as_root;
+
+-- icu_sort_keys
+SELECT icu_sort_keys(ARRAY['b', NULL, 'Été'], 'fr')
+        = ARRAY[icu_sort_key('b', 'fr'), NULL, icu_sort_key('Été', 'fr')] AS coll_arg,
+       icu_sort_keys(ARRAY['a', 'B'] COLLATE "en-x-icu")
+        = ARRAY[icu_sort_key('a' COLLATE "en-x-icu"), icu_sort_key('B' COLLATE "en-x-icu")] AS coll_clause;
+
+-- icu_sortkey
+SELECT v FROM (VALUES ('b'), ('E'), ('a'), ('é'), ('A')) AS s(v)
+ORDER BY icu_sort_key(v, 'en')::icu_sortkey;
+SELECT icu_sort_key('Été', 'fr-u-ks-level1')::icu_sortkey
+        = icu_sort_key('ete', 'fr-u-ks-level1')::icu_sortkey AS eq_level1,
+       icu_sort_key('ab', 'en')::icu_sortkey
+        < icu_sort_key('abc', 'en')::icu_sortkey AS lt_prefix;
+
 -- icu_strpos
 SELECT v,icu_strpos('hey rene', v, 'und@colStrength=primary;colAlternate=shifted')
 FROM (VALUES ('René'), ('rené'), ('Rene'), ('n'), ('në'), ('no'), (''), (null))
  AS s(v)
 ORDER BY v COLLATE "C";
 
+-- icu_text_ops
+SELECT v FROM (VALUES ('b'), ('E'), ('a'), ('é'), ('A')) AS s(v)
+ORDER BY v COLLATE "en-x-icu" USING #<#;
+
+SELECT 'Abc' #=# 'abc' COLLATE "en-x-icu" AS eq_tertiary,
+       'abc' #=# 'abc' COLLATE "en-x-icu" AS eq_identical;
+
 -- icu_transform
 SELECT icu_transform('10\N{SUPERSCRIPT MINUS}\N{SUPERSCRIPT FOUR}'
 		   '\N{MICRO SIGN}m = 1 \N{ANGSTROM SIGN}',
@@ -78,3 +187,18 @@ SELECT icu_transform('Ich muß essen.', '[:^ascii:]; Hex');
 
 -- icu_word_boundaries
 SELECT * FROM icu_word_boundaries($$Do you like O'Reilly books?$$, 'en');
+SELECT * FROM icu_word_boundaries('Hello, world! 42 times.', 'en', '{letter,number}');
+
+-- icu_word_count
+SELECT icu_word_count('Hello, world! 42 times.', 'en') AS words,
+       icu_word_count('Hello, world! 42 times.', 'en', '{number}') AS numbers;
+
+-- icu_word_offsets
+SELECT * FROM icu_word_offsets('Hello, world!', 'en');
+SELECT * FROM icu_word_offsets(E'\u00c9t\u00e9 ok', 'en', bytes => true);
+
+-- icu_wrap
+SELECT icu_wrap_lines('The quick brown fox jumps over the lazy dog.', 10, 'en');
+SELECT icu_wrap_lines('日本語のテキストを折り返す例です。', 10, 'ja');
+SELECT icu_wrap(E'Hello world\n\nSecond paragraph', 12, 'en')
+  = E'Hello world\n\nSecond\nparagraph' AS wrapped;